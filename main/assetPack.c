@@ -0,0 +1,279 @@
+/*
+ * assetPack.c
+ *
+ *  Reads assets from a single contiguous pack file. The pack is located through FatFs once in assetPack_open(),
+ *  after that every asset is found with a hash table lookup and read with direct multi-sector reads, without
+ *  any path building, fopen or cluster chain walks.
+ */
+
+/*
+**====================================================================================
+** Imported definitions
+**====================================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "assetPack.h"
+#include "sdCard.h"
+
+/*
+**====================================================================================
+** Private constant definitions
+**====================================================================================
+*/
+
+#define FNV_OFFSET_BASIS    0x811C9DC5u
+#define FNV_PRIME           0x01000193u
+
+#define SECTORS_FOR_BYTES(n) (((n) + ASSET_PACK_SECTOR_SIZE - 1u) / ASSET_PACK_SECTOR_SIZE)
+
+/*
+**====================================================================================
+** Private function forward declaration
+**====================================================================================
+*/
+
+static uint32_t hash_name(const char *name);
+
+/*
+**====================================================================================
+** Private variable declarations
+**====================================================================================
+*/
+
+static const char *TAG = "Asset Pack";
+
+static uint32_t priv_pack_sector;
+static uint32_t priv_pack_sectors;
+static uint32_t priv_slot_mask;
+
+static uint8_t * priv_index_buffer = NULL;
+static const assetPack_entry_t * priv_index = NULL;
+
+/* Used for reading the last partial sector of an asset. */
+static uint8_t * priv_sector_buffer = NULL;
+
+/*
+**====================================================================================
+** Public function definitions
+**====================================================================================
+*/
+
+/* Locates the pack file on the SD card and loads its index into RAM. sdCard_init() must have been called before. */
+esp_err_t assetPack_open(const char *path)
+{
+    const assetPack_header_t * header;
+    uint32_t pack_size;
+    uint32_t index_sectors;
+    esp_err_t ret;
+
+    if (sdCard_getSectorSize() != ASSET_PACK_SECTOR_SIZE)
+    {
+        ESP_LOGE(TAG, "Unsupported card sector size %lu", sdCard_getSectorSize());
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ret = sdCard_getContiguousFile(path, &priv_pack_sector, &pack_size);
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    priv_pack_sectors = SECTORS_FOR_BYTES(pack_size);
+
+    if (priv_sector_buffer == NULL)
+    {
+        priv_sector_buffer = heap_caps_malloc(ASSET_PACK_SECTOR_SIZE, MALLOC_CAP_DMA);
+        assert(priv_sector_buffer);
+    }
+
+    /* 1. Read and check the header. */
+    ret = sdCard_readSectors(priv_pack_sector, 1u, priv_sector_buffer);
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    header = (const assetPack_header_t *)priv_sector_buffer;
+
+    if ((header->magic != ASSET_PACK_MAGIC) || (header->version != ASSET_PACK_VERSION))
+    {
+        ESP_LOGE(TAG, "%s is not a valid asset pack", path);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    if ((header->slot_count == 0u) || ((header->slot_count & (header->slot_count - 1u)) != 0u))
+    {
+        ESP_LOGE(TAG, "Invalid index slot count %u", header->slot_count);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    priv_slot_mask = header->slot_count - 1u;
+    index_sectors = SECTORS_FOR_BYTES(sizeof(assetPack_header_t) + (header->slot_count * sizeof(assetPack_entry_t)));
+
+    if (index_sectors > priv_pack_sectors)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ESP_LOGI(TAG, "Opened %s : %u assets, starting at sector %lu", path, header->entry_count, priv_pack_sector);
+
+    /* 2. Load the whole index with a single read. */
+    if (priv_index_buffer != NULL)
+    {
+        heap_caps_free(priv_index_buffer);
+        priv_index = NULL;
+    }
+
+    priv_index_buffer = heap_caps_malloc(index_sectors * ASSET_PACK_SECTOR_SIZE, MALLOC_CAP_DMA);
+
+    if (priv_index_buffer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = sdCard_readSectors(priv_pack_sector, index_sectors, priv_index_buffer);
+
+    if (ret == ESP_OK)
+    {
+        priv_index = (const assetPack_entry_t *)(priv_index_buffer + sizeof(assetPack_header_t));
+    }
+
+    return ret;
+}
+
+
+/* Returns the index entry for the given asset name, or NULL if the pack does not contain it. */
+const assetPack_entry_t * assetPack_find(const char *name)
+{
+    uint32_t hash;
+    uint32_t slot;
+
+    if (priv_index == NULL)
+    {
+        return NULL;
+    }
+
+    hash = hash_name(name);
+    slot = hash & priv_slot_mask;
+
+    for (uint32_t probe = 0u; probe <= priv_slot_mask; probe++)
+    {
+        const assetPack_entry_t * entry = &priv_index[slot];
+
+        if (entry->name_hash == hash)
+        {
+            return entry;
+        }
+
+        if (entry->name_hash == 0u)
+        {
+            break;
+        }
+
+        slot = (slot + 1u) & priv_slot_mask;
+    }
+
+    return NULL;
+}
+
+
+/* Reads the data of an asset. Whole sectors are read straight into the output buffer, or in larger chunks
+ * through a bounce buffer if it is in PSRAM. Only the last partial sector goes through an intermediate buffer. */
+esp_err_t assetPack_read(const assetPack_entry_t * entry, void * output_buffer, size_t buffer_size)
+{
+    uint32_t full_sectors = entry->size / ASSET_PACK_SECTOR_SIZE;
+    uint32_t tail_bytes = entry->size % ASSET_PACK_SECTOR_SIZE;
+    uint8_t * dest_ptr = output_buffer;
+    esp_err_t ret = ESP_OK;
+
+    if (buffer_size < entry->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if ((entry->sector + SECTORS_FOR_BYTES(entry->size)) > priv_pack_sectors)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (full_sectors > 0u)
+    {
+        ret = sdCard_readSectors(priv_pack_sector + entry->sector, full_sectors, dest_ptr);
+    }
+
+    if ((ret == ESP_OK) && (tail_bytes > 0u))
+    {
+        ret = sdCard_readSectors(priv_pack_sector + entry->sector + full_sectors, 1u, priv_sector_buffer);
+
+        if (ret == ESP_OK)
+        {
+            memcpy(dest_ptr + (full_sectors * ASSET_PACK_SECTOR_SIZE), priv_sector_buffer, tail_bytes);
+        }
+    }
+
+    return ret;
+}
+
+
+esp_err_t assetPack_load(const char *name, void * output_buffer, size_t buffer_size)
+{
+    const assetPack_entry_t * entry = assetPack_find(name);
+
+    if (entry == NULL)
+    {
+        ESP_LOGE(TAG, "Asset %s not found", name);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    return assetPack_read(entry, output_buffer, buffer_size);
+}
+
+
+/* Loads an RGB565 image, only if it has exactly the expected dimensions. The output buffer must hold
+ * width * height pixels. Returns ESP_ERR_NOT_FOUND if the pack does not contain the image and
+ * ESP_ERR_INVALID_SIZE if it contains something else under that name. */
+esp_err_t assetPack_loadImage(const char *name, uint16_t * output_buffer, uint16_t width, uint16_t height)
+{
+    const assetPack_entry_t * entry = assetPack_find(name);
+
+    if (entry == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if ((entry->format != ASSET_FORMAT_RGB565) || (entry->width != width) || (entry->height != height))
+    {
+        ESP_LOGE(TAG, "%s is not a %ux%u image", name, width, height);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return assetPack_read(entry, output_buffer, (size_t)width * height * sizeof(uint16_t));
+}
+
+/*
+**====================================================================================
+** Private function definitions
+**====================================================================================
+*/
+
+/* 32 bit FNV-1a. Must match name_hash() in tools/pack_assets.py. Zero is reserved for empty slots. */
+static uint32_t hash_name(const char *name)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+
+    while (*name != '\0')
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= FNV_PRIME;
+    }
+
+    return (hash != 0u) ? hash : 1u;
+}
@@ -0,0 +1,61 @@
+/*
+ * assetPack.h
+ *
+ *  Indexed asset pack, produced on the host by tools/pack_assets.py.
+ *
+ *  Layout of the pack file (all values little endian) :
+ *  - Header    : assetPack_header_t, at the very start of the file.
+ *  - Index     : slot_count entries of assetPack_entry_t right after the header. This is an open addressing
+ *                hash table keyed by the FNV-1a hash of the asset name, slot_count is a power of two.
+ *  - Data      : The asset data. Every asset starts on a sector boundary, so it can be read directly with
+ *                multi-sector reads into the destination buffer.
+ */
+
+#ifndef MAIN_ASSETPACK_H_
+#define MAIN_ASSETPACK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ASSET_PACK_MAGIC        0x4B415041u     /* "APAK" */
+#define ASSET_PACK_VERSION      1u
+#define ASSET_PACK_SECTOR_SIZE  512u
+
+typedef enum
+{
+    ASSET_FORMAT_RAW = 0,       /* Data is stored as it was in the source file. */
+    ASSET_FORMAT_RGB565 = 1,    /* width * height pixels, top row first, already converted with CONVERT_888RGB_TO_565RGB. */
+} assetPack_format_t;
+
+#pragma pack(push)
+#pragma pack(1)
+typedef struct
+{
+    uint32_t magic;             /* ASSET_PACK_MAGIC */
+    uint16_t version;           /* ASSET_PACK_VERSION */
+    uint16_t slot_count;        /* Number of index slots, power of two. */
+    uint16_t entry_count;       /* Number of used index slots. */
+    uint16_t reserved;
+    uint32_t data_sector;       /* First data sector, relative to the start of the pack. */
+} assetPack_header_t;
+
+typedef struct
+{
+    uint32_t name_hash;         /* FNV-1a hash of the asset name, 0 marks an empty slot. */
+    uint32_t sector;            /* First sector of the data, relative to the start of the pack. */
+    uint32_t size;              /* Data size in bytes. */
+    uint16_t width;             /* Image width in pixels, 0 for raw data. */
+    uint16_t height;            /* Image height in pixels, 0 for raw data. */
+    uint8_t  format;            /* assetPack_format_t */
+    uint8_t  reserved[3];
+} assetPack_entry_t;
+#pragma pack(pop)
+
+extern esp_err_t assetPack_open(const char *path);
+extern const assetPack_entry_t * assetPack_find(const char *name);
+extern esp_err_t assetPack_read(const assetPack_entry_t * entry, void * output_buffer, size_t buffer_size);
+extern esp_err_t assetPack_load(const char *name, void * output_buffer, size_t buffer_size);
+extern esp_err_t assetPack_loadImage(const char *name, uint16_t * output_buffer, uint16_t width, uint16_t height);
+
+#endif /* MAIN_ASSETPACK_H_ */
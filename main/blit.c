@@ -0,0 +1,318 @@
+/*
+ * blit.c
+ *
+ *  Nearest neighbour scaling and affine (rotate + scale) drawing. The destination rectangle is clipped
+ *  against the screen and the source image before entering the inner loops, so the loops themselves
+ *  only step through source coordinates and copy pixels.
+ */
+
+/*
+**====================================================================================
+** Imported definitions
+**====================================================================================
+*/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "blit.h"
+#include "display.h"
+
+/*
+**====================================================================================
+** Private constant definitions
+**====================================================================================
+*/
+
+#define FX_HALF     (1 << 15)
+
+/*
+**====================================================================================
+** Private function forward declaration
+**====================================================================================
+*/
+
+static int64_t floor_div(int64_t a, int64_t b);
+static void clip_stepper(int64_t start, int64_t step, int64_t limit, int * t_lo, int * t_hi);
+
+/*
+**====================================================================================
+** Private variable declarations
+**====================================================================================
+*/
+
+/* sin() for 0...90 degrees in 16.16 fixed point. */
+static const int32_t priv_sin_table[91] =
+{
+         0,   1144,   2287,   3430,   4572,   5712,   6850,   7987,
+      9121,  10252,  11380,  12505,  13626,  14742,  15855,  16962,
+     18064,  19161,  20252,  21336,  22415,  23486,  24550,  25607,
+     26656,  27697,  28729,  29753,  30767,  31772,  32768,  33754,
+     34729,  35693,  36647,  37590,  38521,  39441,  40348,  41243,
+     42126,  42995,  43852,  44695,  45525,  46341,  47143,  47930,
+     48703,  49461,  50203,  50931,  51643,  52339,  53020,  53684,
+     54332,  54963,  55578,  56175,  56756,  57319,  57865,  58393,
+     58903,  59396,  59870,  60326,  60764,  61183,  61584,  61966,
+     62328,  62672,  62997,  63303,  63589,  63856,  64104,  64332,
+     64540,  64729,  64898,  65048,  65177,  65287,  65376,  65446,
+     65496,  65526,  65536,
+};
+
+/* Source column for every visible destination column of a scaled blit. The same for every row. */
+static uint16_t priv_column_table[DISPLAY_WIDTH];
+
+/*
+**====================================================================================
+** Public function definitions
+**====================================================================================
+*/
+
+/* Draws src stretched to width x height pixels, with the top left corner at x, y. */
+void blit_drawScaled(uint16_t * dest, int x, int y, int width, int height, const blit_image_t * src, uint32_t color_key)
+{
+    int32_t step_x;
+    int32_t step_y;
+    int32_t u;
+    int32_t v;
+    int x0, x1, y0, y1;
+    int span;
+
+    if ((width <= 0) || (height <= 0) || (src->width == 0u) || (src->height == 0u))
+    {
+        return;
+    }
+
+    x0 = MAX(x, 0);
+    y0 = MAX(y, 0);
+    x1 = MIN(x + width, (int)DISPLAY_WIDTH);
+    y1 = MIN(y + height, (int)DISPLAY_HEIGHT);
+
+    if ((x0 >= x1) || (y0 >= y1))
+    {
+        return;
+    }
+
+    step_x = BLIT_INT_TO_FX(src->width) / width;
+    step_y = BLIT_INT_TO_FX(src->height) / height;
+    span = x1 - x0;
+
+    /* Sample at pixel centres, starting from the first visible column. */
+    u = ((x0 - x) * step_x) + (step_x >> 1);
+
+    for (int ix = 0; ix < span; ix++)
+    {
+        priv_column_table[ix] = (uint16_t)(u >> 16);
+        u += step_x;
+    }
+
+    v = ((y0 - y) * step_y) + (step_y >> 1);
+
+    for (int row = y0; row < y1; row++)
+    {
+        const uint16_t * src_row = src->pixels + ((v >> 16) * src->width);
+        uint16_t * dest_ptr = PANEL_PIXEL_PTR(dest, x0, row);
+
+        if (color_key == BLIT_NO_COLOR_KEY)
+        {
+            for (int ix = 0; ix < span; ix++)
+            {
+                dest_ptr[ix] = src_row[priv_column_table[ix]];
+            }
+        }
+        else
+        {
+            for (int ix = 0; ix < span; ix++)
+            {
+                uint16_t pixel = src_row[priv_column_table[ix]];
+
+                if (pixel != color_key)
+                {
+                    dest_ptr[ix] = pixel;
+                }
+            }
+        }
+
+        v += step_y;
+    }
+}
+
+
+/* Draws src rotated clockwise by angle_deg and scaled by scale_fx (16.16, BLIT_FX_ONE is 1:1),
+ * centred at center_x, center_y. */
+void blit_drawRotated(uint16_t * dest, int center_x, int center_y, const blit_image_t * src, int angle_deg, int32_t scale_fx, uint32_t color_key)
+{
+    int32_t sin_a = blit_sinFx(angle_deg);
+    int32_t cos_a = blit_sinFx(angle_deg + 90);
+    int64_t inv_scale;
+    int32_t du_dx, dv_dx, du_dy, dv_dy;
+    int64_t u_row, v_row;
+    int64_t dx, dy;
+    int ext_x, ext_y;
+    int x0, x1, y0, y1;
+    const int64_t u_limit = BLIT_INT_TO_FX(src->width);
+    const int64_t v_limit = BLIT_INT_TO_FX(src->height);
+
+    if ((scale_fx <= 0) || (src->width == 0u) || (src->height == 0u))
+    {
+        return;
+    }
+
+    /* Half size of the bounding box of the rotated and scaled image. */
+    ext_x = (int)((((int64_t)abs(cos_a) * src->width + (int64_t)abs(sin_a) * src->height) * scale_fx) >> 33) + 1;
+    ext_y = (int)((((int64_t)abs(sin_a) * src->width + (int64_t)abs(cos_a) * src->height) * scale_fx) >> 33) + 1;
+
+    x0 = MAX(center_x - ext_x, 0);
+    y0 = MAX(center_y - ext_y, 0);
+    x1 = MIN(center_x + ext_x + 1, (int)DISPLAY_WIDTH);
+    y1 = MIN(center_y + ext_y + 1, (int)DISPLAY_HEIGHT);
+
+    if ((x0 >= x1) || (y0 >= y1))
+    {
+        return;
+    }
+
+    /* Inverse mapping : source steps for one destination pixel to the right and one pixel down. */
+    inv_scale = ((int64_t)1 << 32) / scale_fx;
+    du_dx = (int32_t)((cos_a * inv_scale) >> 16);
+    dv_dx = (int32_t)((-sin_a * inv_scale) >> 16);
+    du_dy = (int32_t)((sin_a * inv_scale) >> 16);
+    dv_dy = (int32_t)((cos_a * inv_scale) >> 16);
+
+    /* Source coordinates of the centre of the top left destination pixel. */
+    dx = BLIT_INT_TO_FX(x0 - center_x) + FX_HALF;
+    dy = BLIT_INT_TO_FX(y0 - center_y) + FX_HALF;
+    u_row = (u_limit >> 1) + (((du_dx * dx) + (du_dy * dy)) >> 16);
+    v_row = (v_limit >> 1) + (((dv_dx * dx) + (dv_dy * dy)) >> 16);
+
+    for (int row = y0; row < y1; row++)
+    {
+        int t_lo = 0;
+        int t_hi = x1 - x0;
+
+        /* Only the part of the row that maps inside the source image is walked. */
+        clip_stepper(u_row, du_dx, u_limit, &t_lo, &t_hi);
+        clip_stepper(v_row, dv_dx, v_limit, &t_lo, &t_hi);
+
+        if (t_lo < t_hi)
+        {
+            int32_t u = (int32_t)(u_row + ((int64_t)t_lo * du_dx));
+            int32_t v = (int32_t)(v_row + ((int64_t)t_lo * dv_dx));
+            uint16_t * dest_ptr = PANEL_PIXEL_PTR(dest, x0 + t_lo, row);
+            uint16_t * dest_end = dest_ptr + (t_hi - t_lo);
+
+            if (color_key == BLIT_NO_COLOR_KEY)
+            {
+                while (dest_ptr < dest_end)
+                {
+                    *dest_ptr++ = src->pixels[((v >> 16) * src->width) + (u >> 16)];
+                    u += du_dx;
+                    v += dv_dx;
+                }
+            }
+            else
+            {
+                while (dest_ptr < dest_end)
+                {
+                    uint16_t pixel = src->pixels[((v >> 16) * src->width) + (u >> 16)];
+
+                    if (pixel != color_key)
+                    {
+                        *dest_ptr = pixel;
+                    }
+
+                    dest_ptr++;
+                    u += du_dx;
+                    v += dv_dx;
+                }
+            }
+        }
+
+        u_row += du_dy;
+        v_row += dv_dy;
+    }
+}
+
+
+/* sin() of a whole number of degrees in 16.16 fixed point, using symmetry of the quarter wave table. */
+int32_t blit_sinFx(int angle_deg)
+{
+    int angle = angle_deg % 360;
+
+    if (angle < 0)
+    {
+        angle += 360;
+    }
+
+    if (angle <= 90)
+    {
+        return priv_sin_table[angle];
+    }
+    else if (angle <= 180)
+    {
+        return priv_sin_table[180 - angle];
+    }
+    else if (angle <= 270)
+    {
+        return -priv_sin_table[angle - 180];
+    }
+    else
+    {
+        return -priv_sin_table[360 - angle];
+    }
+}
+
+/*
+**====================================================================================
+** Private function definitions
+**====================================================================================
+*/
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+
+    if (((a % b) != 0) && ((a < 0) != (b < 0)))
+    {
+        q--;
+    }
+
+    return q;
+}
+
+
+/* Narrows [*t_lo, *t_hi) to the steps t for which 0 <= start + (t * step) < limit. */
+static void clip_stepper(int64_t start, int64_t step, int64_t limit, int * t_lo, int * t_hi)
+{
+    int64_t lo;
+    int64_t hi;
+
+    if (step == 0)
+    {
+        if ((start < 0) || (start >= limit))
+        {
+            *t_hi = *t_lo;
+        }
+        return;
+    }
+
+    if (step > 0)
+    {
+        lo = -floor_div(start, step);                   /* ceil(-start / step) */
+        hi = -floor_div(start - limit, step);           /* ceil((limit - start) / step) */
+    }
+    else
+    {
+        lo = floor_div(start - limit, -step) + 1;
+        hi = floor_div(start, -step) + 1;
+    }
+
+    if (lo > *t_lo)
+    {
+        *t_lo = (int)MIN(lo, (int64_t)*t_hi);
+    }
+
+    if (hi < *t_hi)
+    {
+        *t_hi = (int)MAX(hi, (int64_t)*t_lo);
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * blit.h
+ *
+ *  Scaled and rotated bitmap drawing into a frame buffer of DISPLAY_WIDTH x DISPLAY_HEIGHT pixels.
+ *  Source pixels are sampled with nearest neighbour, using 16.16 fixed point steppers.
+ */
+
+#ifndef MAIN_BLIT_H_
+#define MAIN_BLIT_H_
+
+#include <stdint.h>
+
+/* 16.16 fixed point helpers. */
+#define BLIT_FX_ONE             (1 << 16)
+#define BLIT_INT_TO_FX(i)       ((int32_t)(i) * BLIT_FX_ONE)
+#define BLIT_FX_FROM_PERCENT(p) ((int32_t)(((int64_t)(p) * BLIT_FX_ONE) / 100))
+
+/* Pass as color_key to draw every source pixel. Any 16 bit value is treated as the transparent color. */
+#define BLIT_NO_COLOR_KEY       0xFFFFFFFFu
+
+typedef struct
+{
+    uint16_t width;
+    uint16_t height;
+    const uint16_t * pixels;    /* width * height pixels, top row first. */
+} blit_image_t;
+
+int32_t blit_sinFx(int angle_deg);
+void blit_drawScaled(uint16_t * dest, int x, int y, int width, int height, const blit_image_t * src, uint32_t color_key);
+void blit_drawRotated(uint16_t * dest, int center_x, int center_y, const blit_image_t * src, int angle_deg, int32_t scale_fx, uint32_t color_key);
+
+#endif /* MAIN_BLIT_H_ */
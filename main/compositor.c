@@ -0,0 +1,350 @@
+/*
+ * compositor.c
+ *
+ *  Instead of repainting the whole frame buffer every frame, the compositor keeps a list of dirty rectangles.
+ *  When a sprite moves, its old and new bounds are marked dirty. On render, only the dirty rectangles are
+ *  restored from the cached background, the sprites overlapping them are drawn on top and the result is sent
+ *  to the display. The work per frame thus depends on the sprite area, not on the screen area.
+ */
+
+/*
+**====================================================================================
+** Imported definitions
+**====================================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "compositor.h"
+#include "display.h"
+#include "blit.h"
+
+/*
+**====================================================================================
+** Private type definitions
+**====================================================================================
+*/
+
+typedef struct
+{
+    const uint16_t * pixels;
+    display_rect_t bounds;
+    uint32_t color_key;
+    bool visible;
+    bool in_use;
+} sprite_t;
+
+/*
+**====================================================================================
+** Private function forward declaration
+**====================================================================================
+*/
+
+static bool rect_intersect(const display_rect_t * a, const display_rect_t * b, display_rect_t * result);
+static display_rect_t rect_union(const display_rect_t * a, const display_rect_t * b);
+static void restore_uncovered(const display_rect_t * rect, uint8_t first_sprite);
+static void restore_background(const display_rect_t * rect);
+static void draw_sprite(const sprite_t * sprite, const display_rect_t * clip);
+
+/*
+**====================================================================================
+** Private variable declarations
+**====================================================================================
+*/
+
+static uint16_t * priv_frame_buffer;
+static uint16_t * priv_background;
+
+static sprite_t priv_sprites[COMPOSITOR_MAX_SPRITES];
+
+static display_rect_t priv_dirty_rects[COMPOSITOR_MAX_DIRTY_RECTS];
+static uint8_t priv_dirty_count;
+
+static const display_rect_t priv_screen_rect = { 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT };
+
+/*
+**====================================================================================
+** Public function definitions
+**====================================================================================
+*/
+
+/* Both buffers are full screen. The background is only read by the compositor, the application draws its
+ * static content there once (for example by loading a bitmap into it) and calls compositor_invalidateAll(). */
+void compositor_init(uint16_t * frame_buffer, uint16_t * background)
+{
+    assert(frame_buffer != NULL);
+    assert(background != NULL);
+
+    priv_frame_buffer = frame_buffer;
+    priv_background = background;
+
+    memset(priv_sprites, 0, sizeof(priv_sprites));
+    compositor_invalidateAll();
+}
+
+
+uint16_t * compositor_getBackground(void)
+{
+    return priv_background;
+}
+
+
+/* Marks a region to be re-composited on the next render. Overlapping regions are merged, so that no pixel is
+ * composited twice. */
+void compositor_invalidateRect(const display_rect_t * rect)
+{
+    display_rect_t dirty;
+    bool merged;
+
+    if (!rect_intersect(rect, &priv_screen_rect, &dirty))
+    {
+        return;
+    }
+
+    do
+    {
+        merged = false;
+
+        for (uint8_t ix = 0u; ix < priv_dirty_count; ix++)
+        {
+            display_rect_t overlap;
+
+            /* If the list is full, then we just merge with the first one. */
+            if (rect_intersect(&dirty, &priv_dirty_rects[ix], &overlap) || (priv_dirty_count == COMPOSITOR_MAX_DIRTY_RECTS))
+            {
+                dirty = rect_union(&dirty, &priv_dirty_rects[ix]);
+                priv_dirty_rects[ix] = priv_dirty_rects[--priv_dirty_count];
+                merged = true;
+                break;
+            }
+        }
+    } while (merged);
+
+    priv_dirty_rects[priv_dirty_count++] = dirty;
+}
+
+
+void compositor_invalidateAll(void)
+{
+    priv_dirty_count = 0u;
+    compositor_invalidateRect(&priv_screen_rect);
+}
+
+
+/* Adds a sprite to the top of the sprite layer. Sprites are hidden until compositor_setSpriteVisible() is called.
+ * Pixels equal to color_key are transparent, use BLIT_NO_COLOR_KEY to draw all pixels.
+ * Returns the sprite handle, or COMPOSITOR_INVALID_SPRITE if there are no free slots. */
+int compositor_addSprite(const uint16_t * pixels, uint16_t width, uint16_t height, uint32_t color_key)
+{
+    for (int ix = 0; ix < (int)COMPOSITOR_MAX_SPRITES; ix++)
+    {
+        if (!priv_sprites[ix].in_use)
+        {
+            priv_sprites[ix].pixels = pixels;
+            priv_sprites[ix].bounds.x = 0;
+            priv_sprites[ix].bounds.y = 0;
+            priv_sprites[ix].bounds.width = width;
+            priv_sprites[ix].bounds.height = height;
+            priv_sprites[ix].color_key = color_key;
+            priv_sprites[ix].visible = false;
+            priv_sprites[ix].in_use = true;
+            return ix;
+        }
+    }
+
+    return COMPOSITOR_INVALID_SPRITE;
+}
+
+
+void compositor_moveSprite(int sprite, int x, int y)
+{
+    sprite_t * sprite_ptr;
+
+    assert((sprite >= 0) && (sprite < (int)COMPOSITOR_MAX_SPRITES));
+    sprite_ptr = &priv_sprites[sprite];
+
+    if ((sprite_ptr->bounds.x == x) && (sprite_ptr->bounds.y == y))
+    {
+        return;
+    }
+
+    /* Old bounds need the background restored, new bounds need the sprite drawn. */
+    if (sprite_ptr->visible)
+    {
+        compositor_invalidateRect(&sprite_ptr->bounds);
+    }
+
+    sprite_ptr->bounds.x = x;
+    sprite_ptr->bounds.y = y;
+
+    if (sprite_ptr->visible)
+    {
+        compositor_invalidateRect(&sprite_ptr->bounds);
+    }
+}
+
+
+void compositor_setSpriteVisible(int sprite, bool visible)
+{
+    sprite_t * sprite_ptr;
+
+    assert((sprite >= 0) && (sprite < (int)COMPOSITOR_MAX_SPRITES));
+    sprite_ptr = &priv_sprites[sprite];
+
+    if (sprite_ptr->visible != visible)
+    {
+        sprite_ptr->visible = visible;
+        compositor_invalidateRect(&sprite_ptr->bounds);
+    }
+}
+
+
+/* Re-composites all dirty regions into the frame buffer and sends them to the display. */
+void compositor_render(void)
+{
+    display_rect_t clip;
+
+    for (uint8_t ix = 0u; ix < priv_dirty_count; ix++)
+    {
+        const display_rect_t * dirty = &priv_dirty_rects[ix];
+
+        /* 1. Restore the background that was covered, except where an opaque sprite is drawn over it anyway. */
+        restore_uncovered(dirty, 0u);
+
+        /* 2. Draw the sprites on top, in the order they were added. */
+        for (uint8_t sprite = 0u; sprite < COMPOSITOR_MAX_SPRITES; sprite++)
+        {
+            if (priv_sprites[sprite].in_use && priv_sprites[sprite].visible && rect_intersect(&priv_sprites[sprite].bounds, dirty, &clip))
+            {
+                draw_sprite(&priv_sprites[sprite], &clip);
+            }
+        }
+
+        /* 3. Flush only this region. */
+        display_drawFrameBufferRegion(priv_frame_buffer, dirty->x, dirty->y, dirty->width, dirty->height);
+    }
+
+    priv_dirty_count = 0u;
+}
+
+/*
+**====================================================================================
+** Private function definitions
+**====================================================================================
+*/
+
+static bool rect_intersect(const display_rect_t * a, const display_rect_t * b, display_rect_t * result)
+{
+    int x0 = MAX(a->x, b->x);
+    int y0 = MAX(a->y, b->y);
+    int x1 = MIN(a->x + a->width, b->x + b->width);
+    int y1 = MIN(a->y + a->height, b->y + b->height);
+
+    if ((x0 >= x1) || (y0 >= y1))
+    {
+        return false;
+    }
+
+    result->x = x0;
+    result->y = y0;
+    result->width = x1 - x0;
+    result->height = y1 - y0;
+
+    return true;
+}
+
+
+static display_rect_t rect_union(const display_rect_t * a, const display_rect_t * b)
+{
+    display_rect_t result;
+    int x1 = MAX(a->x + a->width, b->x + b->width);
+    int y1 = MAX(a->y + a->height, b->y + b->height);
+
+    result.x = MIN(a->x, b->x);
+    result.y = MIN(a->y, b->y);
+    result.width = x1 - result.x;
+    result.height = y1 - result.y;
+
+    return result;
+}
+
+
+/* Restores the part of rect that is not covered by an opaque sprite, checking sprites from first_sprite on.
+ * The area around the first opaque sprite found is split into up to four strips (above, below, left and right
+ * of it), and each strip is checked against the remaining sprites. Colour keyed sprites can show the background
+ * through, so they do not count as cover. */
+static void restore_uncovered(const display_rect_t * rect, uint8_t first_sprite)
+{
+    display_rect_t cover;
+    display_rect_t strips[4];
+
+    for (uint8_t sprite = first_sprite; sprite < COMPOSITOR_MAX_SPRITES; sprite++)
+    {
+        const sprite_t * sprite_ptr = &priv_sprites[sprite];
+
+        if (sprite_ptr->in_use && sprite_ptr->visible && (sprite_ptr->color_key == BLIT_NO_COLOR_KEY) &&
+            rect_intersect(&sprite_ptr->bounds, rect, &cover))
+        {
+            int cover_x1 = cover.x + cover.width;
+            int cover_y1 = cover.y + cover.height;
+
+            strips[0] = (display_rect_t){ rect->x, rect->y, rect->width, cover.y - rect->y };
+            strips[1] = (display_rect_t){ rect->x, cover_y1, rect->width, (rect->y + rect->height) - cover_y1 };
+            strips[2] = (display_rect_t){ rect->x, cover.y, cover.x - rect->x, cover.height };
+            strips[3] = (display_rect_t){ cover_x1, cover.y, (rect->x + rect->width) - cover_x1, cover.height };
+
+            for (int ix = 0; ix < 4; ix++)
+            {
+                if ((strips[ix].width > 0) && (strips[ix].height > 0))
+                {
+                    restore_uncovered(&strips[ix], sprite + 1u);
+                }
+            }
+
+            return;
+        }
+    }
+
+    restore_background(rect);
+}
+
+
+static void restore_background(const display_rect_t * rect)
+{
+    for (int row = rect->y; row < (rect->y + rect->height); row++)
+    {
+        memcpy(PANEL_PIXEL_PTR(priv_frame_buffer, rect->x, row),
+               PANEL_PIXEL_PTR(priv_background, rect->x, row),
+               rect->width * sizeof(uint16_t));
+    }
+}
+
+
+/* Draws the part of the sprite that falls within clip. clip must lie within the sprite bounds. */
+static void draw_sprite(const sprite_t * sprite, const display_rect_t * clip)
+{
+    const uint16_t * src_ptr = sprite->pixels + ((clip->y - sprite->bounds.y) * sprite->bounds.width) + (clip->x - sprite->bounds.x);
+
+    for (int row = clip->y; row < (clip->y + clip->height); row++)
+    {
+        uint16_t * dest_ptr = PANEL_PIXEL_PTR(priv_frame_buffer, clip->x, row);
+
+        if (sprite->color_key == BLIT_NO_COLOR_KEY)
+        {
+            memcpy(dest_ptr, src_ptr, clip->width * sizeof(uint16_t));
+        }
+        else
+        {
+            for (int ix = 0; ix < clip->width; ix++)
+            {
+                if (src_ptr[ix] != sprite->color_key)
+                {
+                    dest_ptr[ix] = src_ptr[ix];
+                }
+            }
+        }
+
+        src_ptr += sprite->bounds.width;
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * compositor.h
+ *
+ *  Two layer compositor : a static background layer that is decoded once and kept, and a sprite layer on top.
+ *  Only regions that changed are restored from the background, re-composited and sent to the display.
+ */
+
+#ifndef MAIN_COMPOSITOR_H_
+#define MAIN_COMPOSITOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "display.h"
+
+#define COMPOSITOR_MAX_SPRITES      8u
+#define COMPOSITOR_MAX_DIRTY_RECTS  8u
+#define COMPOSITOR_INVALID_SPRITE   (-1)
+
+void compositor_init(uint16_t * frame_buffer, uint16_t * background);
+uint16_t * compositor_getBackground(void);
+void compositor_invalidateRect(const display_rect_t * rect);
+void compositor_invalidateAll(void);
+
+int  compositor_addSprite(const uint16_t * pixels, uint16_t width, uint16_t height, uint32_t color_key);
+void compositor_moveSprite(int sprite, int x, int y);
+void compositor_setSpriteVisible(int sprite, bool visible);
+
+void compositor_render(void);
+
+#endif /* MAIN_COMPOSITOR_H_ */
@@ -19,6 +19,9 @@
 #include "esp_system.h"
 #include "driver/spi_master.h"
 #include "driver/gpio.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+#include "sdkconfig.h"
 
 #include "display.h"
 
@@ -35,19 +38,20 @@
 #define PIN_NUM_DISPLAY_CS 4
 #define PIN_NUM_BCKL       2
 
+/* Enough transactions for the window setup (5) and a full screen of data chunks. */
+#define DISPLAY_DATA_CHUNKS     ((PANEL_FRAME_BYTES + DISPLAY_MAX_TRANSFER_SIZE - 1u) / DISPLAY_MAX_TRANSFER_SIZE)
+#define DISPLAY_TRANSACTIONS    (5u + DISPLAY_DATA_CHUNKS)
+
+/* The line buffer is split in two halves, used as bounce buffers for data that can not be sent with DMA directly. */
+#define BOUNCE_BUFFER_COUNT     2
+#define BOUNCE_BUFFER_BYTES     (DISPLAY_MAX_TRANSFER_SIZE / BOUNCE_BUFFER_COUNT)
+
 /*
 **====================================================================================
 ** Private type definitions
 **====================================================================================
 */
 
-typedef struct
-{
-    uint8_t cmd;
-    uint8_t data[16];
-    uint8_t databytes; //No of data in data; bit 7 = delay after set; 0xFF = end of cmds.
-} lcd_init_cmd_t;
-
 /*
 **====================================================================================
 ** Private function forward declaration
@@ -58,7 +62,9 @@ static void lcd_spi_pre_transfer_callback(spi_transaction_t *t);
 static void lcd_cmd(spi_device_handle_t spi, const uint8_t cmd, bool keep_cs_active);
 static void lcd_data(spi_device_handle_t spi, const uint8_t *data, int len);
 static void lcd_init(spi_device_handle_t spi);
+static void setup_window_transactions(spi_transaction_t *trans, int xPos, int yPos, int width, int height);
 static void send_display_data(spi_device_handle_t spi, int xPos, int yPos, int width, int height, uint16_t *linedata, bool isBufferConstant);
+static void send_display_data_bounced(spi_device_handle_t spi, int xPos, int yPos, int width, int height, const uint16_t *src, int src_stride);
 static void wait_display_data_finish(spi_device_handle_t spi);
 
 
@@ -67,44 +73,9 @@ static void wait_display_data_finish(spi_device_handle_t spi);
 ** Private variable declarations
 **====================================================================================
 */
-//Place data into DRAM. Constant data gets placed into DROM by default, which is not accessible by DMA.
-DRAM_ATTR static const lcd_init_cmd_t st_init_cmds[]=
-{
-    /* Memory Data Access Control, MX=MV=1, MY=ML=MH=0, RGB=0 */
-    {0x36, {(1 << 7)| (1<<5) }, 1},
-    /* Interface Pixel Format, 16bits/pixel for RGB/MCU interface */
-    {0x3A, {0x55}, 1},
-    /* Porch Setting */
-    {0xB2, {0x0c, 0x0c, 0x00, 0x33, 0x33}, 5},
-    /* Gate Control, Vgh=13.65V, Vgl=-10.43V */
-    {0xB7, {0x45}, 1},
-    /* VCOM Setting, VCOM=1.175V */
-    {0xBB, {0x2B}, 1},
-    /* LCM Control, XOR: BGR, MX, MH */
-    {0xC0, {0x2C}, 1},
-    /* VDV and VRH Command Enable, enable=1 */
-    {0xC2, {0x01, 0xff}, 2},
-    /* VRH Set, Vap=4.4+... */
-    {0xC3, {0x11}, 1},
-    /* VDV Set, VDV=0 */
-    {0xC4, {0x20}, 1},
-    /* Frame Rate Control, 60Hz, inversion=0 */
-    {0xC6, {0x0f}, 1},
-    /* Power Control 1, AVDD=6.8V, AVCL=-4.8V, VDDS=2.3V */
-    {0xD0, {0xA4, 0xA1}, 1},
-    /* Positive Voltage Gamma Control */
-    {0xE0, {0xD0, 0x00, 0x05, 0x0E, 0x15, 0x0D, 0x37, 0x43, 0x47, 0x09, 0x15, 0x12, 0x16, 0x19}, 14},
-    /* Negative Voltage Gamma Control */
-    {0xE1, {0xD0, 0x00, 0x05, 0x0D, 0x0C, 0x06, 0x2D, 0x44, 0x40, 0x0E, 0x1C, 0x18, 0x16, 0x19}, 14},
-    /* Sleep Out */
-    {0x11, {0}, 0x80},
-    /* Display On */
-    {0x29, {0}, 0x80},
-    {0, {0}, 0xff}
-};
-
 static spi_device_handle_t priv_spi_handle;
 static uint16_t *line_data;
+uint8_t priv_number_of_transfers = 0u;
 
 
 /*
@@ -122,7 +93,7 @@ void display_init(void)
         .clock_speed_hz=40*1000*1000,           //Clock out at 40 MHz
         .mode=0,                                //SPI mode 0
         .spics_io_num=PIN_NUM_DISPLAY_CS,       //CS pin
-        .queue_size=12,                         //We want to be able to queue 12 transactions at a time
+        .queue_size=DISPLAY_TRANSACTIONS,       //We want to be able to queue a whole screen update at a time
         .pre_cb=lcd_spi_pre_transfer_callback,  //Specify pre-transfer callback to handle D/C line
     };
 
@@ -137,22 +108,84 @@ void display_init(void)
     //Initialize the LCD
     lcd_init(priv_spi_handle);
 
-    /* This buffer is used by the fill Rectangle function. */
+    /* This buffer is used by the fill Rectangle function, and as bounce buffers for data outside of DMA capable memory. */
     line_data = heap_caps_malloc(DISPLAY_MAX_TRANSFER_SIZE, MALLOC_CAP_DMA);
 }
 
 
+/* Allocates a full screen buffer. With CONFIG_DISPLAY_FRAME_BUFFER_IN_PSRAM it is placed in PSRAM and flushed through
+ * the bounce buffers, otherwise it comes from internal DMA capable memory and is sent directly. */
+uint16_t * display_allocFrameBuffer(void)
+{
+#ifdef CONFIG_DISPLAY_FRAME_BUFFER_IN_PSRAM
+    return heap_caps_malloc(PANEL_FRAME_BYTES, MALLOC_CAP_SPIRAM);
+#else
+    return heap_caps_malloc(PANEL_FRAME_BYTES, MALLOC_CAP_DMA);
+#endif
+}
+
+
+/* Allocates a full screen layer that is only ever copied from by the CPU (e.g. the compositor background),
+ * so it does not need to be DMA capable. */
+uint16_t * display_allocLayerBuffer(void)
+{
+#ifdef CONFIG_DISPLAY_FRAME_BUFFER_IN_PSRAM
+    return heap_caps_malloc(PANEL_FRAME_BYTES, MALLOC_CAP_SPIRAM);
+#else
+    return heap_caps_malloc(PANEL_FRAME_BYTES, MALLOC_CAP_8BIT);
+#endif
+}
+
+
+/* Allocates memory for decoded assets (bitmaps, sprites) following the same placement as the frame buffers. */
+void * display_allocAssetBuffer(size_t size)
+{
+#ifdef CONFIG_DISPLAY_FRAME_BUFFER_IN_PSRAM
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+#else
+    return heap_caps_malloc(size, MALLOC_CAP_DMA);
+#endif
+}
+
+
 void display_drawScreenBuffer(uint16_t *buf)
 {
-    wait_display_data_finish(priv_spi_handle);
-    send_display_data(priv_spi_handle, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, buf, false);
+    display_drawBitmap(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, buf);
 }
 
 
 void display_drawBitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t *bmp_buf)
 {
     wait_display_data_finish(priv_spi_handle);
-    send_display_data(priv_spi_handle, x, y, width, height, bmp_buf, false);
+
+    if (esp_ptr_dma_capable(bmp_buf))
+    {
+        send_display_data(priv_spi_handle, x, y, width, height, bmp_buf, false);
+    }
+    else
+    {
+        send_display_data_bounced(priv_spi_handle, x, y, width, height, bmp_buf, width);
+    }
+}
+
+/* Sends only the given region of a full screen frame buffer to the display. Full width regions are contiguous
+ * in the frame buffer and can be sent directly, otherwise the rows are copied out through the bounce buffers. */
+void display_drawFrameBufferRegion(uint16_t *buf, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
+{
+    if ((width == 0u) || (height == 0u))
+    {
+        return;
+    }
+
+    if (width == DISPLAY_WIDTH)
+    {
+        display_drawBitmap(0, y, width, height, PANEL_PIXEL_PTR(buf, 0, y));
+    }
+    else
+    {
+        wait_display_data_finish(priv_spi_handle);
+        send_display_data_bounced(priv_spi_handle, x, y, width, height, PANEL_PIXEL_PTR(buf, x, y), PANEL_STRIDE);
+    }
 }
 
 /* Draws a rectangle directly on the display at the given coordinates. */
@@ -171,6 +204,24 @@ void display_fillRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t heig
 	send_display_data(priv_spi_handle, x, y, width, height, line_data, true);
 }
 
+/* Returns true while a previously queued transfer is still in progress. Does not block, completed
+ * transactions are collected here so that the next draw call does not have to wait for them. */
+bool display_isFlushPending(void)
+{
+    spi_transaction_t *rtrans;
+
+    while (priv_number_of_transfers > 0u)
+    {
+        if (spi_device_get_trans_result(priv_spi_handle, &rtrans, 0) != ESP_OK)
+        {
+            return true;
+        }
+        priv_number_of_transfers--;
+    }
+
+    return false;
+}
+
 
 /*
 **====================================================================================
@@ -190,7 +241,7 @@ static void lcd_spi_pre_transfer_callback(spi_transaction_t *t)
 static void lcd_init(spi_device_handle_t spi)
 {
     int cmd=0;
-    const lcd_init_cmd_t* lcd_init_cmds;
+    const panel_init_cmd_t* lcd_init_cmds;
 
     //Initialize non-SPI GPIOs
     gpio_config_t io_conf = {};
@@ -205,7 +256,8 @@ static void lcd_init(spi_device_handle_t spi)
     gpio_set_level(PIN_NUM_RST, 1);
     vTaskDelay(100 / portTICK_PERIOD_MS);
 
-    lcd_init_cmds = st_init_cmds;
+    /* The init sequence of the configured controller comes from the panel descriptor. */
+    lcd_init_cmds = panel_init_cmds;
 
     //Send all the commands
     while (lcd_init_cmds[cmd].databytes!=0xff)
@@ -270,30 +322,18 @@ static void lcd_data(spi_device_handle_t spi, const uint8_t *data, int len)
     assert(ret==ESP_OK);            //Should have had no issues.
 }
 
-uint8_t priv_number_of_transfers = 0u;
-
-/* Updates the whole screen */
-static void send_display_data(spi_device_handle_t spi, int xPos, int yPos, int width, int height, uint16_t *linedata, bool isBufferConstant)
+/* Fills in the first 5 transactions : set the address window on the display and start a memory write. */
+static void setup_window_transactions(spi_transaction_t *trans, int xPos, int yPos, int width, int height)
 {
-    esp_err_t ret;
-    int total_size_bytes = width * height * 2;
-    int chunk_ix = 5;
-    uint16_t * line_ptr;
-    int curr_transfer_size;
-
-    //Transaction descriptors. Declared static so they're not allocated on the stack; we need this memory even when this
-    //function is finished because the SPI driver needs access to it even while we're already calculating the next line.
-    static spi_transaction_t trans[12];
-
 	uint16_t end_column = (xPos + width) - 1u;
     uint16_t end_row = (yPos + height) - 1u;
 
-    end_column = MIN(end_column, DISPLAY_WIDTH);
-    end_row = MIN(end_row, DISPLAY_HEIGHT);
+    end_column = MIN(end_column, DISPLAY_WIDTH - 1u) + PANEL_COL_OFFSET;
+    end_row = MIN(end_row, DISPLAY_HEIGHT - 1u) + PANEL_ROW_OFFSET;
+    xPos += PANEL_COL_OFFSET;
+    yPos += PANEL_ROW_OFFSET;
 
-    //In theory, it's better to initialize trans and data only once and hang on to the initialized
-    //variables. We allocate them on the stack, so we need to re-init them each call.
-    for (int ix = 0; ix < 12; ix++)
+    for (int ix = 0; ix < 5; ix++)
     {
         memset(&trans[ix], 0, sizeof(spi_transaction_t));
         trans[ix].flags=SPI_TRANS_USE_TXDATA;
@@ -324,6 +364,30 @@ static void send_display_data(spi_device_handle_t spi, int xPos, int yPos, int w
     trans[4].tx_data[0]=0x2C;           	//memory write
     trans[4].length = 8;
     trans[4].user=(void*)0;
+}
+
+
+/* Updates the whole screen */
+static void send_display_data(spi_device_handle_t spi, int xPos, int yPos, int width, int height, uint16_t *linedata, bool isBufferConstant)
+{
+    esp_err_t ret;
+    int total_size_bytes = width * height * 2;
+    int chunk_ix = 5;
+    uint16_t * line_ptr;
+    int curr_transfer_size;
+
+    //Transaction descriptors. Declared static so they're not allocated on the stack; we need this memory even when this
+    //function is finished because the SPI driver needs access to it even while we're already calculating the next line.
+    static spi_transaction_t trans[DISPLAY_TRANSACTIONS];
+
+    //In theory, it's better to initialize trans and data only once and hang on to the initialized
+    //variables. We allocate them on the stack, so we need to re-init them each call.
+    for (int ix = 5; ix < DISPLAY_TRANSACTIONS; ix++)
+    {
+        memset(&trans[ix], 0, sizeof(spi_transaction_t));
+    }
+
+    setup_window_transactions(trans, xPos, yPos, width, height);
 
     line_ptr = linedata;
 
@@ -356,6 +420,71 @@ static void send_display_data(spi_device_handle_t spi, int xPos, int yPos, int w
 }
 
 
+/* Sends pixel data that can not be handed to the DMA directly : buffers in PSRAM, or a region of a frame buffer whose
+ * rows are not contiguous. The data is copied in bands into the two halves of the line buffer. While one half is being
+ * transferred, the next band is copied into the other one, so the copying overlaps with the SPI transfer. */
+static void send_display_data_bounced(spi_device_handle_t spi, int xPos, int yPos, int width, int height, const uint16_t *src, int src_stride)
+{
+    esp_err_t ret;
+    spi_transaction_t *rtrans;
+    int lines_per_band = BOUNCE_BUFFER_BYTES / (width * sizeof(uint16_t));
+    int lines;
+    int queued = 0;
+    int done = 0;
+    int band = 0;
+
+    //Declared static for the same reason as in send_display_data.
+    static spi_transaction_t trans[5 + BOUNCE_BUFFER_COUNT];
+
+    setup_window_transactions(trans, xPos, yPos, width, height);
+
+    for (int ix = 0; ix < 5; ix++)
+    {
+        ret=spi_device_queue_trans(spi, &trans[ix], portMAX_DELAY);
+        assert(ret==ESP_OK);
+        queued++;
+    }
+
+    for (int row = 0; row < height; row += lines)
+    {
+        int slot = band % BOUNCE_BUFFER_COUNT;
+        uint16_t *bounce = line_data + (slot * (BOUNCE_BUFFER_BYTES / sizeof(uint16_t)));
+        spi_transaction_t *t = &trans[5 + slot];
+
+        lines = MIN(lines_per_band, height - row);
+
+        //Before reusing a bounce buffer, wait until the band that used it before has been sent. Results come back in queue order.
+        if (band >= BOUNCE_BUFFER_COUNT)
+        {
+            while (done <= (5 + band - BOUNCE_BUFFER_COUNT))
+            {
+                ret=spi_device_get_trans_result(spi, &rtrans, portMAX_DELAY);
+                assert(ret==ESP_OK);
+                done++;
+            }
+        }
+
+        for (int line = 0; line < lines; line++)
+        {
+            memcpy(&bounce[line * width], &src[(row + line) * src_stride], width * sizeof(uint16_t));
+        }
+
+        memset(t, 0, sizeof(spi_transaction_t));
+        t->tx_buffer = bounce;
+        t->length = lines * width * sizeof(uint16_t) * 8;
+        t->user = (void*)1;
+
+        ret=spi_device_queue_trans(spi, t, portMAX_DELAY);
+        assert(ret==ESP_OK);
+        queued++;
+        band++;
+    }
+
+    //The remaining transactions are collected by wait_display_data_finish.
+    priv_number_of_transfers = queued - done;
+}
+
+
 static void wait_display_data_finish(spi_device_handle_t spi)
 {
     spi_transaction_t *rtrans;
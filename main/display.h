@@ -8,6 +8,11 @@
 #ifndef DISPLAY_DRIVER_H_
 #define DISPLAY_DRIVER_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "panel.h"
+
 #ifndef MIN
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #endif
@@ -16,7 +21,7 @@
 #endif
 
 
-#define MAX_BMP_LINE_LENGTH 320u
+#define MAX_BMP_LINE_LENGTH MAX(PANEL_WIDTH, PANEL_HEIGHT)
 #define CONVERT_888RGB_TO_565RGB(r, g, b) (((r >> 3) << 3) | (g >> 5) | (((g >> 2) & 0x7u) << 13) | ((b >> 3) << 8))
 
 #define COLOR_BLACK    CONVERT_888RGB_TO_565RGB(0,  0,  0   )
@@ -40,14 +45,29 @@
 #define COLOR_GREENYELLOW    	CONVERT_888RGB_TO_565RGB(173,  255,  47  )
 
 
-#define DISPLAY_WIDTH 320u
-#define DISPLAY_HEIGHT 240u
+/* Geometry comes from the panel descriptor in panel.h, selected in menuconfig. */
+#define DISPLAY_WIDTH PANEL_WIDTH
+#define DISPLAY_HEIGHT PANEL_HEIGHT
+
+#define DISPLAY_MAX_TRANSFER_SIZE (PANEL_FLUSH_LINES * PANEL_WIDTH * PANEL_BYTES_PER_PIXEL)
 
-#define DISPLAY_MAX_TRANSFER_SIZE 40*320*2
+/* Screen area, used for describing damaged regions. */
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+} display_rect_t;
 
 void display_init(void);
+uint16_t * display_allocFrameBuffer(void);
+uint16_t * display_allocLayerBuffer(void);
+void * display_allocAssetBuffer(size_t size);
 void display_drawScreenBuffer(uint16_t *buf);
 void display_fillRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t color);
 void display_drawBitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t *bmp_buf);
+void display_drawFrameBufferRegion(uint16_t *buf, uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+bool display_isFlushPending(void);
 
 #endif /* DISPLAY_H_ */
@@ -0,0 +1,229 @@
+/*
+ * frameScheduler.c
+ *
+ *  Game logic is advanced with a fixed timestep, so the simulation behaves the same regardless of how fast
+ *  we can draw. Rendering is a separate step : if a frame overruns or the display is still busy flushing the
+ *  previous frame, the render is dropped (never the update), so flushes do not pile up behind each other.
+ */
+
+/*
+**====================================================================================
+** Imported definitions
+**====================================================================================
+*/
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "frameScheduler.h"
+#include "display.h"
+
+/*
+**====================================================================================
+** Private constant definitions
+**====================================================================================
+*/
+
+#define US_PER_SECOND   1000000
+#define US_PER_TICK     (portTICK_PERIOD_MS * 1000)
+
+/* Exponential moving average with a weight of 1/8 for the new sample. */
+#define SMOOTH(avg, sample) ((((avg) * 7u) + (sample)) / 8u)
+
+/*
+**====================================================================================
+** Private function forward declaration
+**====================================================================================
+*/
+
+static void wait_for_next_frame(void);
+static void update_fps_counter(int64_t now);
+
+/*
+**====================================================================================
+** Private variable declarations
+**====================================================================================
+*/
+
+static frameScheduler_config_t priv_config;
+static frameScheduler_stats_t priv_stats;
+
+static int64_t priv_update_period_us;
+static int64_t priv_frame_period_us;
+static int64_t priv_accumulator_us;
+static int64_t priv_last_time_us;
+static int64_t priv_next_frame_us;
+
+static int64_t priv_fps_window_start_us;
+static uint32_t priv_fps_window_renders;
+static uint8_t priv_consecutive_skips;
+
+/*
+**====================================================================================
+** Public function definitions
+**====================================================================================
+*/
+
+void frameScheduler_init(const frameScheduler_config_t * config)
+{
+    int64_t now;
+
+    assert(config != NULL);
+    assert(config->update_hz > 0u);
+
+    priv_config = *config;
+
+    if (priv_config.max_updates_per_frame == 0u)
+    {
+        priv_config.max_updates_per_frame = 1u;
+    }
+
+    memset(&priv_stats, 0, sizeof(priv_stats));
+
+    priv_update_period_us = US_PER_SECOND / priv_config.update_hz;
+    frameScheduler_setTargetFps(priv_config.target_fps);
+
+    now = esp_timer_get_time();
+
+    priv_accumulator_us = 0;
+    priv_last_time_us = now;
+    priv_next_frame_us = now;
+    priv_fps_window_start_us = now;
+    priv_fps_window_renders = 0u;
+    priv_consecutive_skips = 0u;
+}
+
+
+/* Runs one frame : waits for the frame slot, executes all due update ticks and then renders if there is time.
+ * Meant to be called from the main loop in place of a fixed delay. */
+void frameScheduler_cycle(void)
+{
+    int64_t frame_start;
+    int64_t start;
+    int64_t now;
+    uint32_t dropped;
+    uint8_t updates = 0u;
+    bool skip_render;
+
+    wait_for_next_frame();
+
+    frame_start = esp_timer_get_time();
+    priv_accumulator_us += frame_start - priv_last_time_us;
+    priv_last_time_us = frame_start;
+
+    /* 1. Advance the game logic in fixed steps. */
+    while ((priv_accumulator_us >= priv_update_period_us) && (updates < priv_config.max_updates_per_frame))
+    {
+        start = esp_timer_get_time();
+
+        if (priv_config.update != NULL)
+        {
+            priv_config.update();
+        }
+
+        priv_stats.update_time_us = SMOOTH(priv_stats.update_time_us, (uint32_t)(esp_timer_get_time() - start));
+        priv_stats.update_count++;
+        priv_accumulator_us -= priv_update_period_us;
+        updates++;
+    }
+
+    if (priv_accumulator_us >= priv_update_period_us)
+    {
+        /* We could not catch up within one frame. Let go of the excess time instead of falling further behind. */
+        dropped = (uint32_t)(priv_accumulator_us / priv_update_period_us);
+        priv_stats.dropped_updates += dropped;
+        priv_accumulator_us -= dropped * priv_update_period_us;
+    }
+
+    /* 2. Render, unless the updates already ate into the next frame or the previous flush is still ongoing. */
+    now = esp_timer_get_time();
+    skip_render = (now >= priv_next_frame_us) || display_isFlushPending();
+
+    if (skip_render && (priv_consecutive_skips < priv_config.max_skipped_renders))
+    {
+        priv_consecutive_skips++;
+        priv_stats.skipped_renders++;
+    }
+    else
+    {
+        start = now;
+
+        if (priv_config.render != NULL)
+        {
+            priv_config.render();
+        }
+
+        now = esp_timer_get_time();
+        priv_stats.render_time_us = SMOOTH(priv_stats.render_time_us, (uint32_t)(now - start));
+        priv_stats.render_count++;
+        priv_fps_window_renders++;
+        priv_consecutive_skips = 0u;
+    }
+
+    priv_stats.load_percent = SMOOTH(priv_stats.load_percent, (uint32_t)(((now - frame_start) * 100) / priv_frame_period_us));
+    update_fps_counter(now);
+}
+
+
+/* The frame rate is limited to the FreeRTOS tick rate, a shorter frame period could not be waited for. */
+void frameScheduler_setTargetFps(uint32_t fps)
+{
+    assert(fps > 0u);
+
+    fps = MIN(fps, (uint32_t)configTICK_RATE_HZ);
+
+    priv_config.target_fps = fps;
+    priv_frame_period_us = US_PER_SECOND / fps;
+}
+
+
+uint32_t frameScheduler_getTargetFps(void)
+{
+    return priv_config.target_fps;
+}
+
+
+void frameScheduler_getStats(frameScheduler_stats_t * stats)
+{
+    *stats = priv_stats;
+}
+
+/*
+**====================================================================================
+** Private function definitions
+**====================================================================================
+*/
+
+/* Sleeps for the remaining part of the current frame period. Note that the delay is limited to the
+ * FreeRTOS tick resolution, the fixed timestep accumulator absorbs the remaining jitter.
+ * We always sleep for at least one tick, even when late, so that the idle task gets to run and feed the watchdog. */
+static void wait_for_next_frame(void)
+{
+    int64_t remaining = priv_next_frame_us - esp_timer_get_time();
+    int64_t now;
+
+    vTaskDelay((TickType_t)MAX(remaining / US_PER_TICK, 1));
+    now = esp_timer_get_time();
+
+    /* If we are more than a whole frame late, then resynchronise instead of trying to render a burst of frames. */
+    if ((now - priv_next_frame_us) > priv_frame_period_us)
+    {
+        priv_next_frame_us = now;
+    }
+
+    priv_next_frame_us += priv_frame_period_us;
+}
+
+
+static void update_fps_counter(int64_t now)
+{
+    if ((now - priv_fps_window_start_us) >= US_PER_SECOND)
+    {
+        priv_stats.render_fps = priv_fps_window_renders;
+        priv_fps_window_renders = 0u;
+        priv_fps_window_start_us = now;
+    }
+}
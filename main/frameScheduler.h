@@ -0,0 +1,41 @@
+/*
+ * frameScheduler.h
+ *
+ *  Fixed timestep frame scheduler. Game logic is advanced in fixed update ticks,
+ *  while rendering runs as a separate step that is dropped when we fall behind.
+ */
+
+#ifndef FRAME_SCHEDULER_H_
+#define FRAME_SCHEDULER_H_
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t update_hz;                 /* Rate of the fixed update ticks. Game logic always advances in steps of 1/update_hz. */
+    uint32_t target_fps;                /* Desired render rate. */
+    uint8_t  max_updates_per_frame;     /* Upper limit of catch-up ticks per frame, keeps a long stall from snowballing. */
+    uint8_t  max_skipped_renders;       /* A render is forced after this many consecutive dropped renders. */
+    void (*update)(void);               /* Called once per update tick. */
+    void (*render)(void);               /* Called once per rendered frame. */
+} frameScheduler_config_t;
+
+typedef struct
+{
+    uint32_t update_count;              /* Total number of update ticks executed. */
+    uint32_t render_count;              /* Total number of frames rendered. */
+    uint32_t skipped_renders;           /* Total number of renders dropped because we were behind or the display was busy. */
+    uint32_t dropped_updates;           /* Update ticks discarded because max_updates_per_frame was exceeded. */
+    uint32_t update_time_us;            /* Smoothed duration of a single update tick. */
+    uint32_t render_time_us;            /* Smoothed duration of a single render step. */
+    uint32_t load_percent;              /* Smoothed busy time relative to the frame period. Values above 100 mean we cannot keep up. */
+    uint32_t render_fps;                /* Number of frames rendered during the last full second. */
+} frameScheduler_stats_t;
+
+void frameScheduler_init(const frameScheduler_config_t * config);
+void frameScheduler_cycle(void);
+void frameScheduler_setTargetFps(uint32_t fps);
+uint32_t frameScheduler_getTargetFps(void);
+void frameScheduler_getStats(frameScheduler_stats_t * stats);
+
+#endif /* FRAME_SCHEDULER_H_ */
@@ -15,6 +15,13 @@
 #include "display.h"
 /* The SD card functionality has been moved to its own separate file for this project. */
 #include "sdCard.h"
+/* Indexed asset pack, built with tools/pack_assets.py. Assets are read with direct sector reads. */
+#include "assetPack.h"
+/* Static background layer and sprite layer, only changed regions are redrawn. */
+#include "compositor.h"
+#include "blit.h"
+/* Fixed timestep update ticks and frame dropping render step. */
+#include "frameScheduler.h"
 
 /*
 **====================================================================================
@@ -41,14 +48,18 @@
 /* Uncomment this to enable the ghost bitmap test. */
 //#define GHOST_TEST
 
+/* Game logic runs at a fixed 40 millisecond step. Rendering aims for the same rate, but is dropped if we fall behind. */
+#define UPDATE_HZ               25u
+#define TARGET_FPS              25u
+#define MAX_UPDATES_PER_FRAME   5u
+#define MAX_SKIPPED_RENDERS     4u
+
 /*
 **====================================================================================
 ** Private macro definitions
 **====================================================================================
 */
 
-#define SET_FRAME_BUF_PIXEL(buf,x,y,color) *((buf) + (x) + (320*(y)))=color
-
 /*
 **====================================================================================
 ** Private type definitions
@@ -62,9 +73,10 @@
 */
 
 Private uint8_t initialize_spi(void);
-Private void drawRectangleInFrameBuf(int xPos, int yPos, int width, int height, uint16_t color);
-Private void drawBmpInFrameBuf(int xPos, int yPos, int width, int height, uint16_t * data_buf);
+Private void gameUpdate(void);
+Private void gameRender(void);
 #ifdef GHOST_TEST
+Private void updateGhost(void);
 Private void drawGhost(void);
 #endif
 
@@ -78,6 +90,8 @@ uint16_t * priv_frame_buffer;
 #ifdef GHOST_TEST
 #define GHOST_SPEED 4
 uint16_t * priv_ghost_buffer;
+uint16_t * priv_background_buffer;
+Private int ghost_sprite;
 Private int ghost_position = 0;
 Private int ghost_direction = GHOST_SPEED;
 #endif
@@ -94,8 +108,8 @@ void app_main(void)
 	/* Check how much RAM we have currently available... */
 	printf("Total available memory: %u bytes\n", heap_caps_get_total_size(MALLOC_CAP_8BIT));
 
-	/*Allocate memory for the frame buffer from the heap. */
-    priv_frame_buffer = heap_caps_malloc(240*320*sizeof(uint16_t), MALLOC_CAP_DMA);
+	/*Allocate memory for the frame buffer from the heap. Goes to PSRAM if enabled in menuconfig. */
+    priv_frame_buffer = display_allocFrameBuffer();
     assert(priv_frame_buffer);
 
 	/*Call the function to initialize the SPI peripheral connected to the SD card. */
@@ -109,11 +123,20 @@ void app_main(void)
 		display_init();
 		sdCard_init();
 
+		if (assetPack_open("/assets.pak") != ESP_OK)
+		{
+			printf("Asset pack not available, falling back to BMP files\n");
+		}
+
 		display_fillRectangle(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, COLOR_ORANGE);
 		vTaskDelay(1000u / portTICK_PERIOD_MS);
 
-		/* Load an image from the SD Card into the frame buffer */
-		sdCard_Read_bmp_file("/logo.bmp", priv_frame_buffer);
+		/* Load an image from the SD Card into the frame buffer. The BMP file is only used if the pack does not have
+		 * the image at all, an image that was rejected for its size would not fit as a BMP either. */
+		if (assetPack_loadImage("logo", priv_frame_buffer, DISPLAY_WIDTH, DISPLAY_HEIGHT) == ESP_ERR_NOT_FOUND)
+		{
+			sdCard_Read_bmp_file("/logo.bmp", priv_frame_buffer, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+		}
 
 		display_drawBitmap(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, priv_frame_buffer);
 	}
@@ -122,27 +145,44 @@ void app_main(void)
 	vTaskDelay(5000u / portTICK_PERIOD_MS);
 
 #ifdef GHOST_TEST
-	priv_ghost_buffer = heap_caps_malloc(64*64*sizeof(uint16_t), MALLOC_CAP_DMA);
+	priv_ghost_buffer = display_allocAssetBuffer(64*64*sizeof(uint16_t));
 	assert(priv_ghost_buffer);
-	sdCard_Read_bmp_file("/ghost.bmp", priv_ghost_buffer);
+	if (assetPack_loadImage("ghost", priv_ghost_buffer, 64, 64) == ESP_ERR_NOT_FOUND)
+	{
+		sdCard_Read_bmp_file("/ghost.bmp", priv_ghost_buffer, 64, 64);
+	}
+
+	/* The background layer is drawn only once. It does not need to be DMA capable, since the compositor copies from it. */
+	priv_background_buffer = display_allocLayerBuffer();
+	assert(priv_background_buffer);
+	panel_fillRect(priv_background_buffer, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, COLOR_WHITE);
+
+	compositor_init(priv_frame_buffer, priv_background_buffer);
+	ghost_sprite = compositor_addSprite(priv_ghost_buffer, 64, 64, BLIT_NO_COLOR_KEY);
+	assert(ghost_sprite != COMPOSITOR_INVALID_SPRITE);
+	compositor_moveSprite(ghost_sprite, ghost_position, (DISPLAY_HEIGHT - 64) / 2);
+	compositor_setSpriteVisible(ghost_sprite, true);
 #endif
 
-	/* The idea is that we will try to keep a cyclic process that is called every 40 milliseconds, we call our
-	 * drawing functions and then delay for the period remaining.
+	/* The game logic is updated in fixed steps of 1/UPDATE_HZ, so it behaves the same no matter how long drawing takes.
+	 * Rendering is called once per frame, but the scheduler drops it if we are behind or the display is still busy.
 	 */
+	const frameScheduler_config_t scheduler_config =
+	{
+		.update_hz = UPDATE_HZ,
+		.target_fps = TARGET_FPS,
+		.max_updates_per_frame = MAX_UPDATES_PER_FRAME,
+		.max_skipped_renders = MAX_SKIPPED_RENDERS,
+		.update = gameUpdate,
+		.render = gameRender,
+	};
 
-	TickType_t xLastWakeTime;
-	const TickType_t xFrequency = 40u / portTICK_PERIOD_MS;
-	xLastWakeTime = xTaskGetTickCount ();
+	frameScheduler_init(&scheduler_config);
 
 	/* Main CPU cycle */
 	while(1)
 	{
-		vTaskDelayUntil( &xLastWakeTime, xFrequency );
-#ifdef GHOST_TEST
-		/* Simple test for drawing a moving bitmap on the screen. */
-		drawGhost();
-#endif
+		frameScheduler_cycle();
 	}
 }
 
@@ -181,41 +221,28 @@ Private uint8_t initialize_spi(void)
 }
 
 
-Private void drawRectangleInFrameBuf(int xPos, int yPos, int width, int height, uint16_t color)
+/* Called at a fixed rate of UPDATE_HZ. All game state changes go here. */
+Private void gameUpdate(void)
 {
-	for (int x = xPos; ((x < (xPos+width)) && (x < 320)); x++)
-	{
-		for (int y = yPos; ((y < (yPos+height)) && (y < 240)); y++)
-		{
-			SET_FRAME_BUF_PIXEL(priv_frame_buffer, x, y, color);
-		}
-	}
+#ifdef GHOST_TEST
+	updateGhost();
+#endif
 }
 
 
-Private void drawBmpInFrameBuf(int xPos, int yPos, int width, int height, uint16_t * data_buf)
+/* Called once per rendered frame. Only draws the current game state, must not modify it.
+ * frameScheduler_getStats() can be used here to lower the level of detail when load_percent gets high. */
+Private void gameRender(void)
 {
-	uint16_t * data_ptr = data_buf;
-
-	for (int x = xPos; (x < (xPos + width)); x++)
-	{
-		for (int y = yPos; (y < (yPos + height)); y++)
-		{
-			if ((x >= 0) && (x < DISPLAY_WIDTH) && (y >= 0) && (y < DISPLAY_HEIGHT))
-			{
-				SET_FRAME_BUF_PIXEL(priv_frame_buffer, x, y, *data_ptr);
-			}
-			data_ptr++;
-		}
-	}
+#ifdef GHOST_TEST
+	/* Simple test for drawing a moving bitmap on the screen. */
+	drawGhost();
+#endif
 }
 
 #ifdef GHOST_TEST
-Private void drawGhost(void)
+Private void updateGhost(void)
 {
-	/* Here we draw the whole screen buffer every time. Note that this is not necessarily the most optimal solution, since it takes a lot
-	 * of time to redraw the whole screen */
-
 	/* Update cube position */
 	ghost_position += ghost_direction;
 
@@ -224,19 +251,19 @@ Private void drawGhost(void)
 		ghost_direction = GHOST_SPEED;
 	}
 
-	if(ghost_position >= (DISPLAY_WIDTH - 64))
+	if(ghost_position >= (int)(DISPLAY_WIDTH - 64))
 	{
 		ghost_direction = 0 - GHOST_SPEED;
 	}
+}
 
-	/* Here we draw the data onto an internal buffer and then pass the whole buffer on to the display driver. */
-	/* 1. Draw the background in the buffer */
-	drawRectangleInFrameBuf(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, COLOR_WHITE);
-	/* 2. Draw the ghost bitmap in the buffer */
-	drawBmpInFrameBuf(ghost_position, 88, 64, 64, priv_ghost_buffer);
 
-	/* 3. Flush the frame buffer. */
-	display_drawScreenBuffer(priv_frame_buffer);
+Private void drawGhost(void)
+{
+	/* Instead of repainting the whole screen, we just tell the compositor where the ghost is now. Only the area
+	 * the ghost moved away from is restored from the background layer, and only the changed area is sent to the display. */
+	compositor_moveSprite(ghost_sprite, ghost_position, (DISPLAY_HEIGHT - 64) / 2);
+	compositor_render();
 }
 #endif
 
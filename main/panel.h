@@ -0,0 +1,288 @@
+/*
+ * panel.h
+ *
+ *  Panel descriptor. Size, rotation and pixel format of the connected panel are selected in menuconfig
+ *  ("Display Panel") and turned into compile time constants here, together with the init sequence of the
+ *  controller that drives it. The fill and blit routines below are inlined with these constants, so strides
+ *  and bounds are immediate values in the inner loops.
+ */
+
+#ifndef MAIN_PANEL_H_
+#define MAIN_PANEL_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+
+/*
+**====================================================================================
+** Panel size, in the native (portrait) orientation of the controller
+**====================================================================================
+*/
+
+#if defined(CONFIG_PANEL_SIZE_240X240)
+#define PANEL_NATIVE_WIDTH      240u
+#define PANEL_NATIVE_HEIGHT     240u
+#define PANEL_RAM_OFFSET        80u     /* The 240x240 glass sits at one end of the 240x320 controller RAM. */
+#define PANEL_CONTROLLER_ST7789 1
+#elif defined(CONFIG_PANEL_SIZE_480X320)
+#define PANEL_NATIVE_WIDTH      320u
+#define PANEL_NATIVE_HEIGHT     480u
+#define PANEL_RAM_OFFSET        0u
+#define PANEL_CONTROLLER_ST7796 1
+#if !defined(CONFIG_DISPLAY_FRAME_BUFFER_IN_PSRAM)
+#error "A 480x320 panel needs CONFIG_DISPLAY_FRAME_BUFFER_IN_PSRAM, its frame buffer does not fit in internal RAM."
+#endif
+#else
+#define PANEL_NATIVE_WIDTH      240u
+#define PANEL_NATIVE_HEIGHT     320u
+#define PANEL_RAM_OFFSET        0u
+#define PANEL_CONTROLLER_ST7789 1
+#endif
+
+/*
+**====================================================================================
+** Rotation, as Memory Data Access Control (0x36) settings
+**====================================================================================
+*/
+
+#define PANEL_MADCTL_MY         (1u << 7)   /* Row address order */
+#define PANEL_MADCTL_MX         (1u << 6)   /* Column address order */
+#define PANEL_MADCTL_MV         (1u << 5)   /* Row / column exchange */
+#define PANEL_MADCTL_BGR        (1u << 3)   /* Blue / red order */
+
+/* The ST7789 init sequence already swaps red and blue with LCM Control (0xC0), the ST7796 does it in MADCTL. */
+#if defined(PANEL_CONTROLLER_ST7796)
+#define PANEL_MADCTL_ORDER      PANEL_MADCTL_BGR
+#else
+#define PANEL_MADCTL_ORDER      0u
+#endif
+
+#if defined(CONFIG_PANEL_ROTATION_90)
+#define PANEL_MADCTL_ROTATION   0u
+#define PANEL_LANDSCAPE         0
+#define PANEL_COL_OFFSET        0u
+#define PANEL_ROW_OFFSET        0u
+#elif defined(CONFIG_PANEL_ROTATION_180)
+#define PANEL_MADCTL_ROTATION   (PANEL_MADCTL_MX | PANEL_MADCTL_MV)
+#define PANEL_LANDSCAPE         1
+#define PANEL_COL_OFFSET        0u
+#define PANEL_ROW_OFFSET        0u
+#elif defined(CONFIG_PANEL_ROTATION_270)
+#define PANEL_MADCTL_ROTATION   (PANEL_MADCTL_MX | PANEL_MADCTL_MY)
+#define PANEL_LANDSCAPE         0
+#define PANEL_COL_OFFSET        0u
+#define PANEL_ROW_OFFSET        PANEL_RAM_OFFSET
+#else
+#define PANEL_MADCTL_ROTATION   (PANEL_MADCTL_MY | PANEL_MADCTL_MV)
+#define PANEL_LANDSCAPE         1
+#define PANEL_COL_OFFSET        PANEL_RAM_OFFSET
+#define PANEL_ROW_OFFSET        0u
+#endif
+
+#define PANEL_MADCTL            (PANEL_MADCTL_ROTATION | PANEL_MADCTL_ORDER)
+
+/* Size of the picture as seen by the application. */
+#if PANEL_LANDSCAPE
+#define PANEL_WIDTH             PANEL_NATIVE_HEIGHT
+#define PANEL_HEIGHT            PANEL_NATIVE_WIDTH
+#else
+#define PANEL_WIDTH             PANEL_NATIVE_WIDTH
+#define PANEL_HEIGHT            PANEL_NATIVE_HEIGHT
+#endif
+
+/*
+**====================================================================================
+** Pixel format
+**====================================================================================
+*/
+
+/* RGB565, 16 bits per pixel. CONVERT_888RGB_TO_565RGB in display.h produces the byte order the panel expects. */
+typedef uint16_t panel_pixel_t;
+#define PANEL_COLMOD            0x55u
+#define PANEL_BYTES_PER_PIXEL   2u
+
+/* Two pixels at once, for the wide stores in panel_fillSpan(). */
+typedef uint32_t __attribute__((__may_alias__)) panel_pixel_pair_t;
+
+#define PANEL_STRIDE            PANEL_WIDTH
+#define PANEL_FRAME_PIXELS      (PANEL_WIDTH * PANEL_HEIGHT)
+#define PANEL_FRAME_BYTES       (PANEL_FRAME_PIXELS * PANEL_BYTES_PER_PIXEL)
+
+/* Number of lines sent with a single SPI transaction when flushing. Kept within a 25 KB line buffer,
+ * which is 40 lines on a 320 pixel wide picture. */
+#define PANEL_FLUSH_BUFFER_BYTES    25600u
+#define PANEL_FLUSH_LINES       (PANEL_FLUSH_BUFFER_BYTES / (PANEL_WIDTH * PANEL_BYTES_PER_PIXEL))
+
+#define PANEL_PIXEL_PTR(buf,x,y) ((buf) + (x) + (PANEL_STRIDE * (y)))
+
+/*
+**====================================================================================
+** Controller init sequence
+**====================================================================================
+*/
+
+typedef struct
+{
+    uint8_t cmd;
+    uint8_t data[16];
+    uint8_t databytes; //No of data in data; bit 7 = delay after set; 0xFF = end of cmds.
+} panel_init_cmd_t;
+
+//Place data into DRAM. Constant data gets placed into DROM by default, which is not accessible by DMA.
+#if defined(PANEL_CONTROLLER_ST7796)
+DRAM_ATTR static const panel_init_cmd_t panel_init_cmds[]=
+{
+    /* Sleep Out */
+    {0x11, {0}, 0x80},
+    /* Command Set Control, enable the extension commands */
+    {0xF0, {0xC3}, 1},
+    {0xF0, {0x96}, 1},
+    /* Memory Data Access Control, rotation and colour order from the panel descriptor */
+    {0x36, {PANEL_MADCTL}, 1},
+    /* Interface Pixel Format, from the panel descriptor */
+    {0x3A, {PANEL_COLMOD}, 1},
+    /* Display Inversion Control, 1-dot inversion */
+    {0xB4, {0x01}, 1},
+    /* Display Function Control, 480 lines */
+    {0xB6, {0x80, 0x02, 0x3B}, 3},
+    /* Display Output Ctrl Adjust */
+    {0xE8, {0x40, 0x8A, 0x00, 0x00, 0x29, 0x19, 0xA5, 0x33}, 8},
+    /* Power Control 2, VAP=4.4V */
+    {0xC1, {0x06}, 1},
+    /* Power Control 3 */
+    {0xC2, {0xA7}, 1},
+    /* VCOM Control, VCOM=0.9V */
+    {0xC5, {0x18}, 0x81},
+    /* Positive Voltage Gamma Control */
+    {0xE0, {0xF0, 0x09, 0x0B, 0x06, 0x04, 0x15, 0x2F, 0x54, 0x42, 0x3C, 0x17, 0x14, 0x18, 0x1B}, 14},
+    /* Negative Voltage Gamma Control */
+    {0xE1, {0xE0, 0x09, 0x0B, 0x06, 0x04, 0x03, 0x2B, 0x43, 0x42, 0x3B, 0x16, 0x14, 0x17, 0x1B}, 0x8E},
+    /* Command Set Control, disable the extension commands again */
+    {0xF0, {0x3C}, 1},
+    {0xF0, {0x69}, 0x81},
+    /* Display On */
+    {0x29, {0}, 0x80},
+    {0, {0}, 0xff}
+};
+#else
+DRAM_ATTR static const panel_init_cmd_t panel_init_cmds[]=
+{
+    /* Memory Data Access Control, rotation from the panel descriptor, RGB=0 */
+    {0x36, {PANEL_MADCTL}, 1},
+    /* Interface Pixel Format, from the panel descriptor */
+    {0x3A, {PANEL_COLMOD}, 1},
+    /* Porch Setting */
+    {0xB2, {0x0c, 0x0c, 0x00, 0x33, 0x33}, 5},
+    /* Gate Control, Vgh=13.65V, Vgl=-10.43V */
+    {0xB7, {0x45}, 1},
+    /* VCOM Setting, VCOM=1.175V */
+    {0xBB, {0x2B}, 1},
+    /* LCM Control, XOR: BGR, MX, MH */
+    {0xC0, {0x2C}, 1},
+    /* VDV and VRH Command Enable, enable=1 */
+    {0xC2, {0x01, 0xff}, 2},
+    /* VRH Set, Vap=4.4+... */
+    {0xC3, {0x11}, 1},
+    /* VDV Set, VDV=0 */
+    {0xC4, {0x20}, 1},
+    /* Frame Rate Control, 60Hz, inversion=0 */
+    {0xC6, {0x0f}, 1},
+    /* Power Control 1, AVDD=6.8V, AVCL=-4.8V, VDDS=2.3V */
+    {0xD0, {0xA4, 0xA1}, 1},
+    /* Positive Voltage Gamma Control */
+    {0xE0, {0xD0, 0x00, 0x05, 0x0E, 0x15, 0x0D, 0x37, 0x43, 0x47, 0x09, 0x15, 0x12, 0x16, 0x19}, 14},
+    /* Negative Voltage Gamma Control */
+    {0xE1, {0xD0, 0x00, 0x05, 0x0D, 0x0C, 0x06, 0x2D, 0x44, 0x40, 0x0E, 0x1C, 0x18, 0x16, 0x19}, 14},
+    /* Sleep Out */
+    {0x11, {0}, 0x80},
+    /* Display On */
+    {0x29, {0}, 0x80},
+    {0, {0}, 0xff}
+};
+#endif
+
+/*
+**====================================================================================
+** Specialised drawing routines
+**====================================================================================
+*/
+
+/* Fills count pixels starting at dest. Uses 32 bit stores, after aligning dest to a pixel pair. */
+static inline void panel_fillSpan(panel_pixel_t * dest, int count, panel_pixel_t color)
+{
+    const uint32_t pattern = ((uint32_t)color << 16) | color;
+    panel_pixel_pair_t * dest_pair;
+
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (((uintptr_t)dest & 0x2u) != 0u)
+    {
+        *dest++ = color;
+        count--;
+    }
+
+    dest_pair = (panel_pixel_pair_t *)dest;
+
+    while (count >= 8)
+    {
+        dest_pair[0] = pattern;
+        dest_pair[1] = pattern;
+        dest_pair[2] = pattern;
+        dest_pair[3] = pattern;
+        dest_pair += 4;
+        count -= 8;
+    }
+
+    while (count >= 2)
+    {
+        *dest_pair++ = pattern;
+        count -= 2;
+    }
+
+    if (count > 0)
+    {
+        *(panel_pixel_t *)dest_pair = color;
+    }
+}
+
+
+/* Fills a rectangle in a frame buffer, clipped to the panel. */
+static inline void panel_fillRect(panel_pixel_t * buf, int x, int y, int width, int height, panel_pixel_t color)
+{
+    int x0 = (x < 0) ? 0 : x;
+    int y0 = (y < 0) ? 0 : y;
+    int x1 = ((x + width) > (int)PANEL_WIDTH) ? (int)PANEL_WIDTH : (x + width);
+    int y1 = ((y + height) > (int)PANEL_HEIGHT) ? (int)PANEL_HEIGHT : (y + height);
+
+    for (int row = y0; row < y1; row++)
+    {
+        panel_fillSpan(PANEL_PIXEL_PTR(buf, x0, row), x1 - x0, color);
+    }
+}
+
+
+/* Copies a width x height bitmap (top row first) into a frame buffer, clipped to the panel. */
+static inline void panel_blit(panel_pixel_t * buf, int x, int y, int width, int height, const panel_pixel_t * src)
+{
+    int x0 = (x < 0) ? 0 : x;
+    int y0 = (y < 0) ? 0 : y;
+    int x1 = ((x + width) > (int)PANEL_WIDTH) ? (int)PANEL_WIDTH : (x + width);
+    int y1 = ((y + height) > (int)PANEL_HEIGHT) ? (int)PANEL_HEIGHT : (y + height);
+
+    if (x0 >= x1)
+    {
+        return;
+    }
+
+    for (int row = y0; row < y1; row++)
+    {
+        memcpy(PANEL_PIXEL_PTR(buf, x0, row), src + ((row - y) * width) + (x0 - x), (x1 - x0) * sizeof(panel_pixel_t));
+    }
+}
+
+#endif /* MAIN_PANEL_H_ */
@@ -0,0 +1,437 @@
+/*
+ * raster.c
+ *
+ *  All primitives are broken down into horizontal spans, which are clipped to the screen and then filled with
+ *  panel_fillSpan(), the same 32 bit wide fill that is used for rectangles. Nothing here writes single pixels,
+ *  so the cost of a primitive depends on the number of rows it covers rather than on its area.
+ */
+
+/*
+**====================================================================================
+** Imported definitions
+**====================================================================================
+*/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "raster.h"
+#include "blit.h"
+
+/*
+**====================================================================================
+** Private constant definitions
+**====================================================================================
+*/
+
+#define FX_ONE      65536
+#define FX_HALF     32768
+
+/* Roughly one arc segment for every ARC_STEP_DEG degrees. */
+#define ARC_STEP_DEG    6
+
+/*
+**====================================================================================
+** Private type definitions
+**====================================================================================
+*/
+
+typedef struct
+{
+    int32_t y_top_fx;       /* Edge covers y_top_fx <= y < y_bottom_fx */
+    int32_t y_bottom_fx;
+    int32_t x_top_fx;
+    int32_t slope_fx;       /* Change of x per one row */
+} edge_t;
+
+/*
+**====================================================================================
+** Private function forward declaration
+**====================================================================================
+*/
+
+static void begin_damage(void);
+static void end_damage(display_rect_t * damage);
+static void fill_span(uint16_t * dest, int y, int x_start, int x_end, uint16_t color);
+static uint32_t isqrt(uint32_t value);
+static int circle_half_width(int radius, int dy);
+static int arc_offset(int32_t sin_fx, int radius);
+
+/*
+**====================================================================================
+** Private variable declarations
+**====================================================================================
+*/
+
+/* Bounding box of all spans drawn by the current primitive. */
+static int priv_damage_x0;
+static int priv_damage_y0;
+static int priv_damage_x1;
+static int priv_damage_y1;
+
+/* Kept off the stack, the main task stack is small. */
+static edge_t priv_edges[RASTER_MAX_POLYGON_POINTS];
+static int32_t priv_crossings[RASTER_MAX_POLYGON_POINTS];
+static raster_point_t priv_arc_points[RASTER_MAX_POLYGON_POINTS];
+
+/*
+**====================================================================================
+** Public function definitions
+**====================================================================================
+*/
+
+/* Bresenham line. Consecutive pixels on the same row are collected into one span. */
+void raster_drawLine(uint16_t * dest, int x0, int y0, int x1, int y1, uint16_t color, display_rect_t * damage)
+{
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int step_x = (x0 < x1) ? 1 : -1;
+    int step_y = (y0 < y1) ? 1 : -1;
+    int err = dx + dy;
+    int x = x0;
+    int y = y0;
+    int run_start = x0;
+
+    begin_damage();
+
+    while (true)
+    {
+        int next_x = x;
+        int next_y = y;
+        int e2;
+
+        if ((x == x1) && (y == y1))
+        {
+            fill_span(dest, y, MIN(run_start, x), MAX(run_start, x) + 1, color);
+            break;
+        }
+
+        e2 = 2 * err;
+
+        if (e2 >= dy)
+        {
+            err += dy;
+            next_x += step_x;
+        }
+
+        if (e2 <= dx)
+        {
+            err += dx;
+            next_y += step_y;
+        }
+
+        if (next_y != y)
+        {
+            fill_span(dest, y, MIN(run_start, x), MAX(run_start, x) + 1, color);
+            run_start = next_x;
+        }
+
+        x = next_x;
+        y = next_y;
+    }
+
+    end_damage(damage);
+}
+
+
+/* One pixel wide circle outline. Each row spans from its own outer edge to the outer edge of the row next to it
+ * (towards the top or bottom), so that the outline has no gaps. */
+void raster_drawCircle(uint16_t * dest, int center_x, int center_y, int radius, uint16_t color, display_rect_t * damage)
+{
+    int y_start = MAX(center_y - radius, 0);
+    int y_end = MIN(center_y + radius, (int)DISPLAY_HEIGHT - 1);
+
+    begin_damage();
+
+    for (int y = y_start; y <= y_end; y++)
+    {
+        int dy = abs(y - center_y);
+        int outer = circle_half_width(radius, dy);
+        int inner = MIN(circle_half_width(radius, dy + 1), outer - 1);
+
+        if (inner < 0)
+        {
+            fill_span(dest, y, center_x - outer, center_x + outer + 1, color);
+        }
+        else
+        {
+            fill_span(dest, y, center_x - outer, center_x - inner, color);
+            fill_span(dest, y, center_x + inner + 1, center_x + outer + 1, color);
+        }
+    }
+
+    end_damage(damage);
+}
+
+
+void raster_fillCircle(uint16_t * dest, int center_x, int center_y, int radius, uint16_t color, display_rect_t * damage)
+{
+    int y_start = MAX(center_y - radius, 0);
+    int y_end = MIN(center_y + radius, (int)DISPLAY_HEIGHT - 1);
+
+    begin_damage();
+
+    for (int y = y_start; y <= y_end; y++)
+    {
+        int half_width = circle_half_width(radius, abs(y - center_y));
+
+        fill_span(dest, y, center_x - half_width, center_x + half_width + 1, color);
+    }
+
+    end_damage(damage);
+}
+
+
+/* Fills a ring segment between inner_radius and outer_radius, going clockwise from start_deg to end_deg
+ * (0 degrees points to the right). The segment may wrap past 0 degrees, e.g. 300 to 60 draws 120 degrees.
+ * Equal angles draw nothing, a difference of a whole multiple of 360 draws the full ring.
+ * With inner_radius 0 this draws a pie slice. Meant for gauges and dials. The arc is approximated with a polygon. */
+void raster_fillArc(uint16_t * dest, int center_x, int center_y, int outer_radius, int inner_radius,
+                    int start_deg, int end_deg, uint16_t color, display_rect_t * damage)
+{
+    int span_deg = (((end_deg - start_deg) % 360) + 360) % 360;
+    int segments;
+    int count = 0;
+
+    if ((span_deg == 0) && (end_deg != start_deg))
+    {
+        span_deg = 360;
+    }
+
+    segments = MIN((span_deg / ARC_STEP_DEG) + 1, (RASTER_MAX_POLYGON_POINTS / 2) - 1);
+
+    if ((span_deg <= 0) || (outer_radius <= 0))
+    {
+        begin_damage();
+        end_damage(damage);
+        return;
+    }
+
+    /* Outer edge from start to end... */
+    for (int ix = 0; ix <= segments; ix++)
+    {
+        int angle = start_deg + ((span_deg * ix) / segments);
+
+        priv_arc_points[count].x = center_x + arc_offset(blit_sinFx(angle + 90), outer_radius);
+        priv_arc_points[count].y = center_y + arc_offset(blit_sinFx(angle), outer_radius);
+        count++;
+    }
+
+    /* ...and the inner edge back from end to start. */
+    if (inner_radius > 0)
+    {
+        for (int ix = segments; ix >= 0; ix--)
+        {
+            int angle = start_deg + ((span_deg * ix) / segments);
+
+            priv_arc_points[count].x = center_x + arc_offset(blit_sinFx(angle + 90), inner_radius);
+            priv_arc_points[count].y = center_y + arc_offset(blit_sinFx(angle), inner_radius);
+            count++;
+        }
+    }
+    else
+    {
+        priv_arc_points[count].x = center_x;
+        priv_arc_points[count].y = center_y;
+        count++;
+    }
+
+    raster_fillPolygon(dest, priv_arc_points, count, color, damage);
+}
+
+
+/* Fills a polygon using the even-odd rule, so concave and self intersecting polygons work as well.
+ * A pixel is filled if its centre lies inside the polygon. */
+void raster_fillPolygon(uint16_t * dest, const raster_point_t * points, int count, uint16_t color, display_rect_t * damage)
+{
+    int edge_count = 0;
+    int y_min = DISPLAY_HEIGHT;
+    int y_max = -1;
+
+    begin_damage();
+
+    if ((count < 3) || (count > RASTER_MAX_POLYGON_POINTS))
+    {
+        end_damage(damage);
+        return;
+    }
+
+    /* 1. Build the edge table once, horizontal edges never cross a pixel centre and are skipped. */
+    for (int ix = 0; ix < count; ix++)
+    {
+        const raster_point_t * a = &points[ix];
+        const raster_point_t * b = &points[(ix + 1) % count];
+        const raster_point_t * top = (a->y < b->y) ? a : b;
+        const raster_point_t * bottom = (a->y < b->y) ? b : a;
+
+        if (a->y == b->y)
+        {
+            continue;
+        }
+
+        priv_edges[edge_count].y_top_fx = top->y * FX_ONE;
+        priv_edges[edge_count].y_bottom_fx = bottom->y * FX_ONE;
+        priv_edges[edge_count].x_top_fx = top->x * FX_ONE;
+        priv_edges[edge_count].slope_fx = (int32_t)(((int64_t)(bottom->x - top->x) * FX_ONE) / (bottom->y - top->y));
+        edge_count++;
+
+        y_min = MIN(y_min, top->y);
+        y_max = MAX(y_max, bottom->y);
+    }
+
+    y_min = MAX(y_min, 0);
+    y_max = MIN(y_max, (int)DISPLAY_HEIGHT - 1);
+
+    /* 2. For every row, find where the edges cross the pixel centres and fill between pairs of crossings. */
+    for (int y = y_min; y <= y_max; y++)
+    {
+        int32_t y_fx = (y * FX_ONE) + FX_HALF;
+        int crossings = 0;
+
+        for (int ix = 0; ix < edge_count; ix++)
+        {
+            const edge_t * edge = &priv_edges[ix];
+
+            if ((y_fx >= edge->y_top_fx) && (y_fx < edge->y_bottom_fx))
+            {
+                int32_t x_fx = edge->x_top_fx + (int32_t)(((int64_t)(y_fx - edge->y_top_fx) * edge->slope_fx) / FX_ONE);
+                int pos = crossings++;
+
+                /* Insertion sort, there are only a few crossings per row. */
+                while ((pos > 0) && (priv_crossings[pos - 1] > x_fx))
+                {
+                    priv_crossings[pos] = priv_crossings[pos - 1];
+                    pos--;
+                }
+
+                priv_crossings[pos] = x_fx;
+            }
+        }
+
+        for (int ix = 0; (ix + 1) < crossings; ix += 2)
+        {
+            /* First and last pixel whose centre lies between the two crossings. */
+            int x_start = (priv_crossings[ix] + FX_HALF - 1) >> 16;
+            int x_end = (priv_crossings[ix + 1] + FX_HALF - 1) >> 16;
+
+            fill_span(dest, y, x_start, x_end, color);
+        }
+    }
+
+    end_damage(damage);
+}
+
+/*
+**====================================================================================
+** Private function definitions
+**====================================================================================
+*/
+
+static void begin_damage(void)
+{
+    priv_damage_x0 = DISPLAY_WIDTH;
+    priv_damage_y0 = DISPLAY_HEIGHT;
+    priv_damage_x1 = 0;
+    priv_damage_y1 = 0;
+}
+
+
+static void end_damage(display_rect_t * damage)
+{
+    if (damage == NULL)
+    {
+        return;
+    }
+
+    if (priv_damage_x0 >= priv_damage_x1)
+    {
+        /* Nothing was drawn. */
+        damage->x = 0;
+        damage->y = 0;
+        damage->width = 0;
+        damage->height = 0;
+    }
+    else
+    {
+        damage->x = priv_damage_x0;
+        damage->y = priv_damage_y0;
+        damage->width = priv_damage_x1 - priv_damage_x0;
+        damage->height = priv_damage_y1 - priv_damage_y0;
+    }
+}
+
+
+/* Fills x_start <= x < x_end on row y, clipped to the screen. */
+static void fill_span(uint16_t * dest, int y, int x_start, int x_end, uint16_t color)
+{
+    if ((y < 0) || (y >= (int)DISPLAY_HEIGHT))
+    {
+        return;
+    }
+
+    x_start = MAX(x_start, 0);
+    x_end = MIN(x_end, (int)DISPLAY_WIDTH);
+
+    if (x_start >= x_end)
+    {
+        return;
+    }
+
+    panel_fillSpan(PANEL_PIXEL_PTR(dest, x_start, y), x_end - x_start, color);
+
+    priv_damage_x0 = MIN(priv_damage_x0, x_start);
+    priv_damage_x1 = MAX(priv_damage_x1, x_end);
+    priv_damage_y0 = MIN(priv_damage_y0, y);
+    priv_damage_y1 = MAX(priv_damage_y1, y + 1);
+}
+
+
+static uint32_t isqrt(uint32_t value)
+{
+    uint32_t root = 0u;
+    uint32_t bit = 1u << 30;
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+
+    while (bit != 0u)
+    {
+        if (value >= (root + bit))
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+
+/* Half width of a filled circle on the row dy away from the centre, -1 outside of the circle.
+ * Uses (radius + 0.5)^2, which gives rounder small circles than radius^2. */
+static int circle_half_width(int radius, int dy)
+{
+    if (dy > radius)
+    {
+        return -1;
+    }
+
+    return (int)isqrt((uint32_t)((radius * radius) + radius - (dy * dy)));
+}
+
+
+/* Offset of an arc vertex from the centre pixel, for a sine or cosine of sin_fx. Polygon vertices lie on pixel
+ * corners, so the arc is placed around the middle of the centre pixel, with radius + 0.5 to match the filled
+ * circle. The arithmetic shift rounds negative offsets the same way as positive ones. */
+static int arc_offset(int32_t sin_fx, int radius)
+{
+    return ((sin_fx * ((2 * radius) + 1)) + (2 * FX_ONE)) >> 17;
+}
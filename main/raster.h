@@ -0,0 +1,30 @@
+/*
+ * raster.h
+ *
+ *  Span based drawing of lines, circles, arcs and polygons into a frame buffer of DISPLAY_WIDTH x DISPLAY_HEIGHT
+ *  pixels. Every primitive reports the area it touched in damage (may be NULL), e.g. for compositor_invalidateRect().
+ */
+
+#ifndef MAIN_RASTER_H_
+#define MAIN_RASTER_H_
+
+#include <stdint.h>
+#include "display.h"
+
+/* Upper limit for the number of polygon vertices. */
+#define RASTER_MAX_POLYGON_POINTS   128
+
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+} raster_point_t;
+
+void raster_drawLine(uint16_t * dest, int x0, int y0, int x1, int y1, uint16_t color, display_rect_t * damage);
+void raster_drawCircle(uint16_t * dest, int center_x, int center_y, int radius, uint16_t color, display_rect_t * damage);
+void raster_fillCircle(uint16_t * dest, int center_x, int center_y, int radius, uint16_t color, display_rect_t * damage);
+void raster_fillArc(uint16_t * dest, int center_x, int center_y, int outer_radius, int inner_radius,
+                    int start_deg, int end_deg, uint16_t color, display_rect_t * damage);
+void raster_fillPolygon(uint16_t * dest, const raster_point_t * points, int count, uint16_t color, display_rect_t * damage);
+
+#endif /* MAIN_RASTER_H_ */
@@ -8,8 +8,13 @@
 #include <string.h>
 
 #include "esp_timer.h"
+#include "esp_memory_utils.h"
+#include "esp_heap_caps.h"
 #include "esp_task_wdt.h"
 #include "esp_vfs_fat.h"
+#include "sdmmc_cmd.h"
+#include "diskio_sdmmc.h"
+#include "ff.h"
 
 #include "sdCard.h"
 #include "display.h"
@@ -17,6 +22,9 @@
 #define MOUNT_POINT "/sdcard"
 #define PIN_NUM_SDCARD_CS    7
 
+/* Size of the bounce buffer used for reading sectors into memory that is not DMA capable. */
+#define READ_BOUNCE_SECTORS  8u
+
 
 /****************** Private type definitions *******************/
 
@@ -45,13 +53,20 @@ typedef struct
 
 
 /**************** Private function forward declarations **************/
-static esp_err_t read_bmp_file(const char *path, uint16_t * output_buffer);
+static esp_err_t read_bmp_file(const char *path, uint16_t * output_buffer, uint16_t width, uint16_t height);
 static const char *TAG = "SD Card Handler";
 
 /**************** Private variable declarations ******************/
 
 uint8_t  bmp_line_buffer[(MAX_BMP_LINE_LENGTH * 3) + 4u];
 
+static sdmmc_card_t * priv_card = NULL;
+static uint8_t priv_pdrv;
+static uint8_t * priv_read_bounce_buffer = NULL;
+
+/* With a per file cache, FIL holds a whole sector buffer, which does not fit on the small main task stack. */
+static FIL priv_file;
+
 /**************** Public functions  **************/
 void sdCard_init(void)
 {
@@ -65,7 +80,6 @@ void sdCard_init(void)
         .allocation_unit_size = 16 * 1024
     };
 
-    sdmmc_card_t *card;
     const char mount_point[] = MOUNT_POINT;
 
     ESP_LOGI(TAG, "Initializing SD card");
@@ -85,7 +99,7 @@ void sdCard_init(void)
     slot_config.host_id = host.slot;
 
     ESP_LOGI(TAG, "Mounting filesystem");
-    ret = esp_vfs_fat_sdspi_mount(mount_point, &host, &slot_config, &mount_config, &card);
+    ret = esp_vfs_fat_sdspi_mount(mount_point, &host, &slot_config, &mount_config, &priv_card);
 
     if (ret != ESP_OK)
     {
@@ -99,25 +113,138 @@ void sdCard_init(void)
             ESP_LOGE(TAG, "Failed to initialize the card (%s). "
                      "Make sure SD card lines have pull-up resistors in place.", esp_err_to_name(ret));
         }
+        priv_card = NULL;
         return;
     }
 
+    /* Remember the FatFs drive number, so that we can look up files without going through the VFS layer. */
+    priv_pdrv = ff_diskio_get_pdrv_card(priv_card);
+
     ESP_LOGI(TAG, "Filesystem mounted");
 }
 
 
-void sdCard_Read_bmp_file(const char *path, uint16_t * output_buffer)
+/* Reads a 24 bit BMP file into output_buffer, which must hold width * height pixels.
+ * Files with any other dimensions are rejected, so they can never overrun the buffer. */
+esp_err_t sdCard_Read_bmp_file(const char *path, uint16_t * output_buffer, uint16_t width, uint16_t height)
 {
 	char str[64] = MOUNT_POINT;
 	strcat(str, path);
 
-	read_bmp_file(str, output_buffer);
+	return read_bmp_file(str, output_buffer, width, height);
+}
+
+
+/* Looks up a file through FatFs and returns the first physical sector of its data, so that it can afterwards
+ * be read with sdCard_readSectors() without any file system overhead.
+ * This only works if the file occupies one contiguous run of clusters, which is checked here once. */
+esp_err_t sdCard_getContiguousFile(const char *path, uint32_t * start_sector, uint32_t * size)
+{
+	char str[64];
+	FATFS *fs;
+	DWORD first_cluster;
+	FSIZE_t cluster_bytes;
+	esp_err_t ret = ESP_OK;
+
+	if (priv_card == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	snprintf(str, sizeof(str), "%u:%s", priv_pdrv, path);
+
+	if (f_open(&priv_file, str, FA_READ) != FR_OK)
+	{
+		ESP_LOGE(TAG, "Failed to open file %s", path);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	fs = priv_file.obj.fs;
+	first_cluster = priv_file.obj.sclust;
+	cluster_bytes = (FSIZE_t)fs->csize * sdCard_getSectorSize();
+
+	/* Walk the cluster chain once. Seeking one byte into each cluster makes FatFs load that cluster into priv_file.clust. */
+	for (FSIZE_t ofs = cluster_bytes; ofs < f_size(&priv_file); ofs += cluster_bytes)
+	{
+		if ((f_lseek(&priv_file, ofs + 1u) != FR_OK) || (priv_file.clust != (first_cluster + (ofs / cluster_bytes))))
+		{
+			ESP_LOGE(TAG, "File %s is fragmented", path);
+			ret = ESP_ERR_INVALID_STATE;
+			break;
+		}
+	}
+
+	if (ret == ESP_OK)
+	{
+		*start_sector = (uint32_t)(fs->database + ((first_cluster - 2u) * fs->csize));
+		*size = (uint32_t)f_size(&priv_file);
+	}
+
+	f_close(&priv_file);
+
+	return ret;
+}
+
+
+/* Reads raw sectors directly from the card. DMA capable output buffers are read with a single multi-sector read.
+ * For other buffers (e.g. PSRAM) the driver would fall back to reading one sector at a time, so these are read
+ * in chunks of READ_BOUNCE_SECTORS through an internal bounce buffer instead. */
+esp_err_t sdCard_readSectors(uint32_t start_sector, uint32_t sector_count, void * output_buffer)
+{
+	uint32_t sector_size;
+	uint8_t * dest_ptr = output_buffer;
+	esp_err_t ret = ESP_OK;
+
+	if (priv_card == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if (esp_ptr_dma_capable(output_buffer) && (((uintptr_t)output_buffer & 0x03u) == 0u))
+	{
+		return sdmmc_read_sectors(priv_card, output_buffer, start_sector, sector_count);
+	}
+
+	sector_size = priv_card->csd.sector_size;
+
+	if (priv_read_bounce_buffer == NULL)
+	{
+		priv_read_bounce_buffer = heap_caps_malloc(READ_BOUNCE_SECTORS * sector_size, MALLOC_CAP_DMA);
+
+		if (priv_read_bounce_buffer == NULL)
+		{
+			return ESP_ERR_NO_MEM;
+		}
+	}
+
+	while ((sector_count > 0u) && (ret == ESP_OK))
+	{
+		uint32_t chunk = MIN(sector_count, READ_BOUNCE_SECTORS);
+
+		ret = sdmmc_read_sectors(priv_card, priv_read_bounce_buffer, start_sector, chunk);
+
+		if (ret == ESP_OK)
+		{
+			memcpy(dest_ptr, priv_read_bounce_buffer, chunk * sector_size);
+			dest_ptr += chunk * sector_size;
+			start_sector += chunk;
+			sector_count -= chunk;
+		}
+	}
+
+	return ret;
+}
+
+
+uint32_t sdCard_getSectorSize(void)
+{
+	return (priv_card != NULL) ? priv_card->csd.sector_size : 512u;
 }
 
 /*********** Private functions ***********/
 
 
-static esp_err_t read_bmp_file(const char *path, uint16_t * output_buffer)
+static esp_err_t read_bmp_file(const char *path, uint16_t * output_buffer, uint16_t width, uint16_t height)
 {
 	BMPHeader header;
 	FILE *f;
@@ -134,11 +261,24 @@ static esp_err_t read_bmp_file(const char *path, uint16_t * output_buffer)
         return ESP_FAIL;
     }
 
-    fread(&header, sizeof(BMPHeader), 1u, f);
+    if (fread(&header, sizeof(BMPHeader), 1u, f) != 1u)
+    {
+        ESP_LOGE(TAG, "Failed to read bitmap header");
+        fclose(f);
+        return ESP_FAIL;
+    }
 
     ESP_LOGE(TAG, "Bitmap width : %ld", header.width_px);
     ESP_LOGE(TAG, "Bitmap height : %ld", header.height_px);
 
+    /* Both the line buffer and the output buffer are sized for the expected image, anything else would overrun them. */
+    if ((header.bits_per_pixel != 24u) || (header.width_px != width) || (header.height_px != height) || (width > MAX_BMP_LINE_LENGTH))
+    {
+        ESP_LOGE(TAG, "Expected a 24 bit %ux%u bitmap", width, height);
+        fclose(f);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
     /* Take padding into account... */
     line_px_data_len = header.width_px * 3u;
     line_stride = (line_px_data_len + 3u) & ~0x03;
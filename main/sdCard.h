@@ -8,7 +8,13 @@
 #ifndef MAIN_SDCARD_H_
 #define MAIN_SDCARD_H_
 
+#include <stdint.h>
+#include "esp_err.h"
+
 extern void sdCard_init(void);
-extern void sdCard_Read_bmp_file(const char *path, uint16_t * output_buffer);
+extern esp_err_t sdCard_Read_bmp_file(const char *path, uint16_t * output_buffer, uint16_t width, uint16_t height);
+extern esp_err_t sdCard_getContiguousFile(const char *path, uint32_t * start_sector, uint32_t * size);
+extern esp_err_t sdCard_readSectors(uint32_t start_sector, uint32_t sector_count, void * output_buffer);
+extern uint32_t sdCard_getSectorSize(void);
 
 #endif /* MAIN_SDCARD_H_ */
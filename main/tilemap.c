@@ -0,0 +1,257 @@
+/*
+ * tilemap.c
+ *
+ *  Draws the visible part of a tile map into a frame buffer, with per pixel scrolling. A small cache remembers
+ *  which tile was last drawn into each screen cell. As long as the scroll position stays the same, only cells
+ *  whose tile changed are redrawn. When scrolling, all visible tiles are redrawn, but never more than fit on screen.
+ */
+
+/*
+**====================================================================================
+** Imported definitions
+**====================================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "tilemap.h"
+#include "assetPack.h"
+
+/*
+**====================================================================================
+** Private constant definitions
+**====================================================================================
+*/
+
+/* Number of tiles visible at once, one extra for the partial tiles at the edges when scrolled. */
+#define CACHE_COLS      (((PANEL_WIDTH + TILEMAP_TILE_SIZE - 1) / TILEMAP_TILE_SIZE) + 1)
+#define CACHE_ROWS      (((PANEL_HEIGHT + TILEMAP_TILE_SIZE - 1) / TILEMAP_TILE_SIZE) + 1)
+
+#define CACHE_EMPTY     0xFFFFu
+
+/*
+**====================================================================================
+** Private function forward declaration
+**====================================================================================
+*/
+
+static void draw_tile(uint16_t * dest, int x, int y, const uint16_t * tile);
+
+/*
+**====================================================================================
+** Private variable declarations
+**====================================================================================
+*/
+
+static const char *TAG = "Tilemap";
+
+static const tilemap_tileset_t * priv_tileset;
+static const tilemap_map_t * priv_map;
+
+static int priv_scroll_x;
+static int priv_scroll_y;
+static int priv_drawn_scroll_x;
+static int priv_drawn_scroll_y;
+
+/* Tile index last drawn into each visible cell, CACHE_EMPTY if the cell needs to be drawn. */
+static uint16_t priv_cache[CACHE_ROWS][CACHE_COLS];
+
+/*
+**====================================================================================
+** Public function definitions
+**====================================================================================
+*/
+
+/* Loads a tileset from the asset pack. The tileset image must be a vertical strip of tiles, TILEMAP_TILE_SIZE pixels
+ * wide, so that the pixels of every tile are stored consecutively. */
+esp_err_t tilemap_loadTileset(const char *asset_name, tilemap_tileset_t * tileset)
+{
+    const assetPack_entry_t * entry = assetPack_find(asset_name);
+    uint16_t * pixels;
+    esp_err_t ret;
+
+    if (entry == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if ((entry->format != ASSET_FORMAT_RGB565) || (entry->width != TILEMAP_TILE_SIZE) || ((entry->height % TILEMAP_TILE_SIZE) != 0u))
+    {
+        ESP_LOGE(TAG, "%s is not a %d pixel wide tile strip", asset_name, TILEMAP_TILE_SIZE);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    pixels = display_allocAssetBuffer(entry->size);
+
+    if (pixels == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = assetPack_read(entry, pixels, entry->size);
+
+    if (ret != ESP_OK)
+    {
+        heap_caps_free(pixels);
+        return ret;
+    }
+
+    tileset->pixels = pixels;
+    tileset->tile_count = entry->height / TILEMAP_TILE_SIZE;
+
+    return ESP_OK;
+}
+
+
+void tilemap_init(const tilemap_tileset_t * tileset, const tilemap_map_t * map)
+{
+    assert(tileset != NULL);
+    assert(tileset->tile_count > 0u);
+    assert(map != NULL);
+
+    priv_tileset = tileset;
+    priv_map = map;
+    priv_scroll_x = 0;
+    priv_scroll_y = 0;
+
+    tilemap_invalidate();
+}
+
+
+/* Sets the map position shown in the top left corner of the screen, in pixels. Clamped so that the screen stays
+ * within the map. */
+void tilemap_setScroll(int x, int y)
+{
+    int max_x = (priv_map->width * TILEMAP_TILE_SIZE) - (int)PANEL_WIDTH;
+    int max_y = (priv_map->height * TILEMAP_TILE_SIZE) - (int)PANEL_HEIGHT;
+
+    priv_scroll_x = MAX(MIN(x, max_x), 0);
+    priv_scroll_y = MAX(MIN(y, max_y), 0);
+}
+
+
+/* Changes a single tile of the map. It is redrawn on the next tilemap_draw() if it is visible.
+ * Tile indices that are not in the tileset are ignored. */
+void tilemap_setTile(int col, int row, uint8_t tile)
+{
+    if ((col >= 0) && (col < priv_map->width) && (row >= 0) && (row < priv_map->height) && (tile < priv_tileset->tile_count))
+    {
+        priv_map->tiles[(row * priv_map->width) + col] = tile;
+    }
+}
+
+
+/* Forces all visible tiles to be redrawn, e.g. after something else has drawn over the tile map. */
+void tilemap_invalidate(void)
+{
+    for (int row = 0; row < CACHE_ROWS; row++)
+    {
+        for (int col = 0; col < CACHE_COLS; col++)
+        {
+            priv_cache[row][col] = CACHE_EMPTY;
+        }
+    }
+}
+
+
+/* Draws the tiles that are visible and have changed since the last call into dest, a full screen buffer.
+ * Returns true if anything was drawn, with the bounding box of the drawn area in damage. */
+bool tilemap_draw(uint16_t * dest, display_rect_t * damage)
+{
+    int first_col = priv_scroll_x / TILEMAP_TILE_SIZE;
+    int first_row = priv_scroll_y / TILEMAP_TILE_SIZE;
+    int fine_x = priv_scroll_x % TILEMAP_TILE_SIZE;
+    int fine_y = priv_scroll_y % TILEMAP_TILE_SIZE;
+    int cols = MIN((fine_x + (int)PANEL_WIDTH + TILEMAP_TILE_SIZE - 1) / TILEMAP_TILE_SIZE, priv_map->width - first_col);
+    int rows = MIN((fine_y + (int)PANEL_HEIGHT + TILEMAP_TILE_SIZE - 1) / TILEMAP_TILE_SIZE, priv_map->height - first_row);
+    int x0 = PANEL_WIDTH;
+    int y0 = PANEL_HEIGHT;
+    int x1 = 0;
+    int y1 = 0;
+
+    /* When scrolled, every cell shows a different part of the map. */
+    if ((priv_scroll_x != priv_drawn_scroll_x) || (priv_scroll_y != priv_drawn_scroll_y))
+    {
+        tilemap_invalidate();
+        priv_drawn_scroll_x = priv_scroll_x;
+        priv_drawn_scroll_y = priv_scroll_y;
+    }
+
+    for (int row = 0; row < rows; row++)
+    {
+        const uint8_t * map_row = &priv_map->tiles[((first_row + row) * priv_map->width) + first_col];
+        int y = (row * TILEMAP_TILE_SIZE) - fine_y;
+
+        for (int col = 0; col < cols; col++)
+        {
+            uint8_t tile = map_row[col];
+            int x = (col * TILEMAP_TILE_SIZE) - fine_x;
+
+            /* Indices outside of the tileset are drawn as tile 0, so that the cell never keeps stale pixels. */
+            if (tile >= priv_tileset->tile_count)
+            {
+                tile = 0u;
+            }
+
+            if (priv_cache[row][col] == tile)
+            {
+                continue;
+            }
+
+            priv_cache[row][col] = tile;
+            draw_tile(dest, x, y, &priv_tileset->pixels[tile * TILEMAP_TILE_PIXELS]);
+
+            x0 = MIN(x0, x);
+            y0 = MIN(y0, y);
+            x1 = MAX(x1, x + TILEMAP_TILE_SIZE);
+            y1 = MAX(y1, y + TILEMAP_TILE_SIZE);
+        }
+    }
+
+    /* Report the drawn area, clipped to the screen. */
+    x0 = MAX(x0, 0);
+    y0 = MAX(y0, 0);
+    x1 = MIN(x1, (int)PANEL_WIDTH);
+    y1 = MIN(y1, (int)PANEL_HEIGHT);
+
+    if ((x0 >= x1) || (y0 >= y1))
+    {
+        return false;
+    }
+
+    if (damage != NULL)
+    {
+        damage->x = x0;
+        damage->y = y0;
+        damage->width = x1 - x0;
+        damage->height = y1 - y0;
+    }
+
+    return true;
+}
+
+/*
+**====================================================================================
+** Private function definitions
+**====================================================================================
+*/
+
+/* Copies one tile to screen position x, y. Tiles at the screen edges are clipped. */
+static void draw_tile(uint16_t * dest, int x, int y, const uint16_t * tile)
+{
+    int x_start = MAX(0, -x);
+    int y_start = MAX(0, -y);
+    int x_end = MIN(TILEMAP_TILE_SIZE, (int)PANEL_WIDTH - x);
+    int y_end = MIN(TILEMAP_TILE_SIZE, (int)PANEL_HEIGHT - y);
+
+    for (int row = y_start; row < y_end; row++)
+    {
+        memcpy(PANEL_PIXEL_PTR(dest, x + x_start, y + row),
+               &tile[(row * TILEMAP_TILE_SIZE) + x_start],
+               (x_end - x_start) * sizeof(uint16_t));
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * tilemap.h
+ *
+ *  Tile based background renderer. A tileset of 16x16 RGB565 tiles is loaded once and a level is stored as an
+ *  array of tile indices, so levels much larger than the screen cost only a few bytes per tile.
+ */
+
+#ifndef MAIN_TILEMAP_H_
+#define MAIN_TILEMAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "display.h"
+
+#define TILEMAP_TILE_SIZE       16
+#define TILEMAP_TILE_PIXELS     (TILEMAP_TILE_SIZE * TILEMAP_TILE_SIZE)
+
+typedef struct
+{
+    const uint16_t * pixels;    /* tile_count tiles, each stored as TILEMAP_TILE_PIXELS consecutive pixels. */
+    uint16_t tile_count;
+} tilemap_tileset_t;
+
+typedef struct
+{
+    uint16_t width;             /* Map width in tiles. */
+    uint16_t height;            /* Map height in tiles. */
+    uint8_t * tiles;            /* width * height tile indices, top row first. */
+} tilemap_map_t;
+
+esp_err_t tilemap_loadTileset(const char *asset_name, tilemap_tileset_t * tileset);
+void tilemap_init(const tilemap_tileset_t * tileset, const tilemap_map_t * map);
+void tilemap_setScroll(int x, int y);
+void tilemap_setTile(int col, int row, uint8_t tile);
+void tilemap_invalidate(void);
+bool tilemap_draw(uint16_t * dest, display_rect_t * damage);
+
+#endif /* MAIN_TILEMAP_H_ */
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""
+Builds an asset pack for main/assetPack.c.
+
+24 bit BMP files are converted to RGB565 in the same byte order as CONVERT_888RGB_TO_565RGB in
+main/display.h, so they can be read straight into a frame buffer. All other files are stored as they are.
+Assets are named after their file name without the extension, e.g. ghost.bmp becomes "ghost".
+
+Copy the resulting file to a freshly formatted SD card, so that it is stored contiguously.
+
+Usage: pack_assets.py -o assets.pak logo.bmp ghost.bmp ...
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+PACK_MAGIC = 0x4B415041     # "APAK"
+PACK_VERSION = 1
+SECTOR_SIZE = 512
+
+FORMAT_RAW = 0
+FORMAT_RGB565 = 1
+
+HEADER = struct.Struct("<IHHHHI")       # assetPack_header_t
+ENTRY = struct.Struct("<IIIHHB3x")      # assetPack_entry_t
+
+
+def name_hash(name):
+    """32 bit FNV-1a, must match hash_name() in main/assetPack.c. Zero is reserved for empty slots."""
+    h = 0x811C9DC5
+    for c in name.encode("ascii"):
+        h ^= c
+        h = (h * 0x01000193) & 0xFFFFFFFF
+    return h if h != 0 else 1
+
+
+def convert_888_to_565(r, g, b):
+    """Same as the CONVERT_888RGB_TO_565RGB macro : RGB565 with the bytes already swapped for the display."""
+    return (((r >> 3) << 3) | (g >> 5) | (((g >> 2) & 0x7) << 13) | ((b >> 3) << 8)) & 0xFFFF
+
+
+def load_bmp(data):
+    """Returns (width, height, rgb565 bytes) for an uncompressed 24 bit BMP, or None for anything else."""
+    if len(data) < 54 or data[0:2] != b"BM":
+        return None
+
+    offset, = struct.unpack_from("<I", data, 10)
+    width, height, planes, bpp, compression = struct.unpack_from("<iiHHI", data, 18)
+
+    if bpp != 24 or compression != 0:
+        return None
+
+    bottom_up = height > 0
+    height = abs(height)
+    stride = (width * 3 + 3) & ~3
+    pixels = bytearray()
+
+    for y in range(height):
+        row = (height - 1 - y) if bottom_up else y
+        line = offset + row * stride
+        for x in range(width):
+            b, g, r = data[line + x * 3: line + x * 3 + 3]
+            pixels += struct.pack("<H", convert_888_to_565(r, g, b))
+
+    return width, height, bytes(pixels)
+
+
+def pad_to_sector(blob):
+    return blob + bytes(-len(blob) % SECTOR_SIZE)
+
+
+def build_pack(paths):
+    assets = []
+    hashes = {}
+
+    for path in paths:
+        name = os.path.splitext(os.path.basename(path))[0]
+        h = name_hash(name)
+
+        if h in hashes:
+            sys.exit("error: '%s' and '%s' have the same name hash, rename one of them" % (name, hashes[h]))
+        hashes[h] = name
+
+        with open(path, "rb") as f:
+            data = f.read()
+
+        bmp = load_bmp(data) if path.lower().endswith(".bmp") else None
+
+        if bmp is not None:
+            width, height, data = bmp
+            assets.append((name, h, FORMAT_RGB565, width, height, data))
+        else:
+            assets.append((name, h, FORMAT_RAW, 0, 0, data))
+
+    # Keep the hash table at most half full, so lookups rarely need more than one probe.
+    slot_count = 1
+    while slot_count < max(1, len(assets) * 2):
+        slot_count *= 2
+
+    index_size = HEADER.size + slot_count * ENTRY.size
+    data_sector = (index_size + SECTOR_SIZE - 1) // SECTOR_SIZE
+
+    slots = [None] * slot_count
+    body = bytearray()
+
+    for name, h, fmt, width, height, data in assets:
+        sector = data_sector + len(body) // SECTOR_SIZE
+        body += pad_to_sector(data)
+
+        slot = h & (slot_count - 1)
+        while slots[slot] is not None:
+            slot = (slot + 1) & (slot_count - 1)
+        slots[slot] = ENTRY.pack(h, sector, len(data), width, height, fmt)
+
+        print("%-24s %-7s %5d x %-5d %8d bytes @ sector %d" %
+              (name, "RGB565" if fmt == FORMAT_RGB565 else "raw", width, height, len(data), sector))
+
+    index = HEADER.pack(PACK_MAGIC, PACK_VERSION, slot_count, len(assets), 0, data_sector)
+    index += b"".join(s if s is not None else bytes(ENTRY.size) for s in slots)
+
+    return pad_to_sector(index) + bytes(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build an indexed asset pack for the SD card.")
+    parser.add_argument("-o", "--output", default="assets.pak", help="output pack file")
+    parser.add_argument("assets", nargs="+", help="asset files to include")
+    args = parser.parse_args()
+
+    pack = build_pack(args.assets)
+
+    with open(args.output, "wb") as f:
+        f.write(pack)
+
+    print("Wrote %s (%d bytes)" % (args.output, len(pack)))
+
+
+if __name__ == "__main__":
+    main()